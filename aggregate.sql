@@ -0,0 +1,102 @@
+CREATE TABLE IF NOT EXISTS CCTNode(
+    Id INTEGER PRIMARY KEY,
+    Parent INTEGER REFERENCES CCTNode(Id),
+    Thread INTEGER REFERENCES Thread(Id),
+    Function INTEGER REFERENCES Function(Id),
+    Segment INTEGER REFERENCES Segment(Id),
+    CallLine INTEGER,
+    CallColumn INTEGER,
+    Count INTEGER,
+    Inclusive INTEGER,
+    Exclusive INTEGER,
+    MinDuration INTEGER,
+    MaxDuration INTEGER
+);
+
+CREATE TABLE IF NOT EXISTS AccessSummary(
+    Id INTEGER PRIMARY KEY,
+    Instruction INTEGER REFERENCES Instruction(Id),
+    Reference INTEGER REFERENCES Reference(Id),
+    Reads INTEGER,
+    Writes INTEGER,
+    ReadBytes INTEGER,
+    WriteBytes INTEGER,
+    FirstTSC INTEGER,
+    LastTSC INTEGER
+);
+
+CREATE TABLE IF NOT EXISTS ConflictSummary(
+    Id INTEGER PRIMARY KEY,
+    TagInstance1 INTEGER REFERENCES TagInstance(Id),
+    TagInstance2 INTEGER REFERENCES TagInstance(Id),
+    Reference INTEGER REFERENCES Reference(Id),
+    Type1 INTEGER,
+    Type2 INTEGER,
+    Count INTEGER,
+    FirstAccess1 INTEGER,
+    FirstAccess2 INTEGER,
+    LastAccess1 INTEGER,
+    LastAccess2 INTEGER,
+    LowAddress INTEGER,
+    HighAddress INTEGER
+);
+
+CREATE TABLE IF NOT EXISTS LoopHeader(
+    Id INTEGER PRIMARY KEY,
+    Function INTEGER REFERENCES Function(Id),
+    Line INTEGER,
+    Column INTEGER
+);
+
+CREATE TABLE IF NOT EXISTS LoopExecutionSummary(
+    Id INTEGER PRIMARY KEY,
+    Loop INTEGER REFERENCES LoopHeader(Id),
+    Thread INTEGER REFERENCES Thread(Id),
+    Segment INTEGER REFERENCES Segment(Id),
+    Start INTEGER,
+    End INTEGER,
+    Iterations INTEGER,
+    MinIteration INTEGER,
+    MaxIteration INTEGER,
+    Dependencies INTEGER,
+    MinDistance INTEGER
+);
+
+CREATE TABLE IF NOT EXISTS LoopIterationSegment(
+    Execution INTEGER REFERENCES LoopExecutionSummary(Id),
+    Iteration INTEGER,
+    Segment INTEGER REFERENCES Segment(Id),
+    Start INTEGER,
+    End INTEGER
+);
+
+CREATE TABLE IF NOT EXISTS AccessSampling(
+    Period INTEGER,
+    Burst INTEGER,
+    SlowdownBudget INTEGER
+);
+
+CREATE TABLE IF NOT EXISTS SegmentSampling(
+    Segment INTEGER REFERENCES Segment(Id),
+    Accesses INTEGER,
+    Sampled INTEGER
+);
+
+CREATE TABLE IF NOT EXISTS ToolStats(
+    Id INTEGER PRIMARY KEY,
+    Thread INTEGER REFERENCES Thread(Id),
+    Name TEXT,
+    Calls INTEGER,
+    Cycles INTEGER
+);
+
+CREATE VIEW IF NOT EXISTS ReferenceName AS
+SELECT Id,
+    CASE Type
+        WHEN 1 THEN 'S: ' || printf('%x', Address) || ':' || StackDelta || ':' || Function
+        WHEN 2 THEN printf('%x', Address)
+        WHEN 4 THEN 'G: ' || printf('%x', Address)
+        WHEN 5 THEN 'P: ' || printf('%x', Address) || ':' || StackDelta || ':' || Function
+        ELSE Name
+    END AS Name
+FROM Reference;
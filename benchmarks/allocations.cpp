@@ -0,0 +1,44 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+/* Allocation storm, blocks of varying sizes are allocated, touched and freed in a shuffled order */
+
+int main(int argc, char* argv[])
+{
+    int blocks = argc > 1 ? atoi(argv[1]) : 1000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 100;
+
+    std::vector<char*> live(blocks, (char*)NULL);
+    long sum = 0;
+
+    srand(1);
+
+    for (int round = 0; round < rounds; round++)
+    {
+        for (int i = 0; i < blocks; i++)
+        {
+            int slot = rand() % blocks;
+
+            if (live[slot] != NULL)
+            {
+                sum += live[slot][0];
+                free(live[slot]);
+            }
+
+            size_t size = 16 + rand() % 4096;
+
+            live[slot] = (char*)malloc(size);
+            memset(live[slot], round, size);
+        }
+    }
+
+    for (int i = 0; i < blocks; i++)
+        free(live[i]);
+
+    printf("%ld\n", sum);
+
+    return 0;
+}
@@ -0,0 +1,400 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <pin.H>
+
+#include "sqlite.h"
+#include "telemetry.h"
+
+/* Runs every target program natively and under pintool_dynamic with each setting, prints one CSV row per target and
+ * setting with the slowdown, events processed per second, peak RSS and database size */
+
+struct Target
+{
+    const char* name;
+    const char* arguments;
+};
+
+static const Target targets[] = {
+    {"pointerchase", "200000 20"},
+    {"stream", "1000000 20"},
+    {"allocations", "1000 200"},
+    {"recursion", "5000 200"},
+    {"pipeline", "100000 64"},
+    {"tagchurn", "2000 100"}
+};
+
+struct Setting
+{
+    std::string name;
+    std::string knobs;
+};
+
+static const Setting defaultSettings[] = {
+    {"exact", ""},
+    {"aggregate", "-cct 1 -aggregate-accesses 1 -summarize-conflicts 1"},
+    {"memory", "-db-mode memory"},
+    {"burst", "-sampling-period 100 -sampling-burst 10"},
+    {"budget", "-slowdown-budget 10"}
+};
+
+struct Options
+{
+    std::string pin;
+    std::string tools;
+    std::string targets;
+    std::string sources;
+    std::string work;
+    int runs;
+
+    std::vector<std::string> only;
+    std::vector<Setting> settings;
+};
+
+struct Run
+{
+    bool succeeded;
+    double seconds;
+    long peakRSS;
+};
+
+/* A tag instruction found in a target's source, see pipeline.cpp */
+struct TagMarker
+{
+    std::string name;
+    std::string type;
+    std::string instruction;
+    int line;
+};
+
+std::vector<std::string> split(const std::string& text)
+{
+    std::vector<std::string> words;
+    std::istringstream stream(text);
+    std::string word;
+
+    while (stream >> word)
+        words.push_back(word);
+
+    return words;
+}
+
+/* Fastest of the runs, the peak RSS is the highest one */
+Run run(const std::vector<std::string>& command, int runs)
+{
+    Run result = {true, 0, 0};
+
+    for (int i = 0; i < runs; i++)
+    {
+        std::vector<char*> argv;
+
+        for (auto& it : command)
+            argv.push_back((char*)it.c_str());
+
+        argv.push_back(NULL);
+
+        auto begin = std::chrono::steady_clock::now();
+
+        pid_t pid = fork();
+
+        if (pid == 0)
+        {
+            int null = open("/dev/null", O_WRONLY);
+
+            dup2(null, STDOUT_FILENO);
+            execvp(argv[0], argv.data());
+
+            perror(argv[0]);
+            _exit(127);
+        }
+
+        int status;
+        struct rusage usage;
+
+        if (pid < 0 || wait4(pid, &status, 0, &usage) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            result.succeeded = false;
+            return result;
+        }
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        if (i == 0 || seconds < result.seconds)
+            result.seconds = seconds;
+
+        result.peakRSS = std::max(result.peakRSS, usage.ru_maxrss);
+    }
+
+    return result;
+}
+
+bool copyFile(const std::string& from, const std::string& to)
+{
+    std::ifstream source(from, std::ios::binary);
+    std::ofstream destination(to, std::ios::binary | std::ios::trunc);
+
+    destination << source.rdbuf();
+
+    return source.good() && destination.good();
+}
+
+long fileSize(const std::string& file)
+{
+    struct stat info;
+
+    return stat(file.c_str(), &info) == 0 ? info.st_size : -1;
+}
+
+/* Events processed by all threads of a finished run, the page stays behind after the process exits */
+UINT64 countEvents(const std::string& file)
+{
+    const TelemetryPage* page = openTelemetryPage(file);
+
+    if (page == NULL)
+        return 0;
+
+    UINT64 events = 0;
+
+    for (uint32_t i = 0; i < page->header.threads; i++)
+        events += observe(&page->threads[i].events);
+
+    closeTelemetryPage(page);
+
+    return events;
+}
+
+std::vector<TagMarker> findTagMarkers(const std::string& source)
+{
+    static const std::regex marker("//\\s*tag:\\s*(\\w+)\\s+(\\w+)\\s+(Start|Stop)\\s*$");
+
+    std::vector<TagMarker> markers;
+    std::ifstream file(source);
+    std::string line;
+
+    for (int number = 1; std::getline(file, line); number++)
+    {
+        std::smatch match;
+
+        if (std::regex_search(line, match, marker))
+            markers.push_back({match[1], match[2], match[3], number});
+    }
+
+    return markers;
+}
+
+/* Source file with the tags of the markers, their locations come from the database of the static tool */
+void writeSource(const std::string& file, const std::string& database, const std::string& sourceName, const std::vector<TagMarker>& markers)
+{
+    std::shared_ptr<SQLite::Connection> db(new SQLite::Connection(database.c_str()));
+    std::shared_ptr<SQLite::Statement> findLocation = db->makeStatement(
+        "SELECT MIN(SourceLocation.Id) FROM SourceLocation JOIN Function ON SourceLocation.Function = Function.Id "
+        "JOIN File ON Function.File = File.Id WHERE File.Path LIKE ? AND SourceLocation.Line = ?");
+
+    std::vector<std::string> tags;
+    std::ostringstream instructions;
+
+    for (auto& it : markers)
+    {
+        auto tag = std::find(tags.begin(), tags.end(), it.name);
+
+        if (tag == tags.end())
+            tag = tags.insert(tags.end(), it.name);
+
+        findLocation->bindAll("%/" + sourceName, it.line);
+
+        int location = findLocation->stepRow() ? findLocation->columnInt(0) : 0;
+
+        findLocation->reset();
+        findLocation->clearBindings();
+
+        if (location == 0)
+        {
+            std::cerr << "No source location for " << sourceName << ":" << it.line << ", tag " << it.name << " skipped" << std::endl;
+            continue;
+        }
+
+        instructions << "  - {type: " << it.instruction << ", location: " << location << ", tag: " << tag - tags.begin() + 1 << "}" << std::endl;
+    }
+
+    std::ofstream source(file, std::ios::trunc);
+
+    source << "tags:" << std::endl;
+
+    for (auto& it : tags)
+    {
+        auto marker = std::find_if(markers.begin(), markers.end(), [&](const TagMarker& marker) { return marker.name == it; });
+
+        source << "  - {name: " << it << ", type: " << marker->type << "}" << std::endl;
+    }
+
+    if (tags.empty())
+        source << "  []" << std::endl;
+
+    source << "tagInstructions:" << std::endl;
+    source << (instructions.str().empty() ? "  []\n" : instructions.str());
+    source << "flags: {processAccessesByDefault: true, processCallsByDefault: true}" << std::endl;
+}
+
+void benchmark(const Options& options, const Target& target)
+{
+    std::string program = options.targets + "/benchmark_" + target.name;
+    std::string prefix = options.work + "/" + target.name;
+    std::string filter = options.work + "/filter.yaml";
+    std::vector<std::string> arguments = split(target.arguments);
+
+    std::vector<std::string> native(1, program);
+    native.insert(native.end(), arguments.begin(), arguments.end());
+
+    Run baseline = run(native, options.runs);
+
+    if (!baseline.succeeded)
+    {
+        std::cerr << "Skipping " << target.name << ", it failed to run natively" << std::endl;
+        return;
+    }
+
+    // Static information is gathered once, every setting starts from a copy of it
+    std::string staticDatabase = prefix + ".static.db";
+    unlink(staticDatabase.c_str());
+
+    std::vector<std::string> collect = {options.pin, "-t", options.tools + "/libpintool_static.so", "-db", staticDatabase, "-filter", filter, "--"};
+    collect.insert(collect.end(), native.begin(), native.end());
+
+    if (!run(collect, 1).succeeded)
+    {
+        std::cerr << "Skipping " << target.name << ", pintool_static failed" << std::endl;
+        return;
+    }
+
+    std::string sourceName = std::string(target.name) + ".cpp";
+    std::string source = prefix + ".source.yaml";
+
+    writeSource(source, staticDatabase, sourceName, findTagMarkers(options.sources + "/" + sourceName));
+
+    for (auto& setting : options.settings)
+    {
+        std::string database = prefix + "." + setting.name + ".db";
+        std::string telemetry = prefix + "." + setting.name + ".telemetry";
+
+        if (!copyFile(staticDatabase, database))
+        {
+            std::cerr << "Cannot copy " << staticDatabase << std::endl;
+            return;
+        }
+
+        std::vector<std::string> command = {options.pin, "-t", options.tools + "/libpintool_dynamic.so", "-db", database,
+                                            "-source", source, "-filter", filter, "-telemetry", telemetry};
+
+        std::vector<std::string> knobs = split(setting.knobs);
+        command.insert(command.end(), knobs.begin(), knobs.end());
+        command.push_back("--");
+        command.insert(command.end(), native.begin(), native.end());
+
+        Run traced = run(command, options.runs);
+
+        if (!traced.succeeded)
+        {
+            std::cerr << target.name << " failed under setting " << setting.name << std::endl;
+            continue;
+        }
+
+        UINT64 events = countEvents(telemetry);
+
+        printf("%s,%s,%.3f,%.3f,%.2f,%llu,%.0f,%ld,%ld\n", target.name, setting.name.c_str(), baseline.seconds, traced.seconds,
+               traced.seconds / baseline.seconds, (unsigned long long)events, events / traced.seconds, traced.peakRSS, fileSize(database));
+        fflush(stdout);
+    }
+}
+
+int usage()
+{
+    std::cerr << "Usage: pintool_benchmark [-pin pin] [-tools dir] [-targets dir] [-sources dir] [-work dir] [-runs n] [-only target]... [-setting name=knobs]..." << std::endl;
+    std::cerr << "Settings given replace the default ones, e.g. -setting \"cct=-cct 1\"." << std::endl;
+
+    return -1;
+}
+
+bool parseOptions(int argc, char* argv[], Options* options)
+{
+    options->pin = PIN_BINARY;
+    options->tools = TOOL_DIR;
+    options->targets = BENCHMARK_TARGET_DIR;
+    options->sources = BENCHMARK_SOURCE_DIR;
+    options->work = "benchmark";
+    options->runs = 3;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+
+        if (i + 1 >= argc)
+            return false;
+
+        std::string value = argv[++i];
+
+        if (arg == "-pin")
+            options->pin = value;
+        else if (arg == "-tools")
+            options->tools = value;
+        else if (arg == "-targets")
+            options->targets = value;
+        else if (arg == "-sources")
+            options->sources = value;
+        else if (arg == "-work")
+            options->work = value;
+        else if (arg == "-runs")
+            options->runs = std::max(1, atoi(value.c_str()));
+        else if (arg == "-only")
+            options->only.push_back(value);
+        else if (arg == "-setting" && value.find('=') != std::string::npos)
+            options->settings.push_back({value.substr(0, value.find('=')), value.substr(value.find('=') + 1)});
+        else
+            return false;
+    }
+
+    if (options->settings.empty())
+        options->settings.assign(std::begin(defaultSettings), std::end(defaultSettings));
+
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+
+    if (!parseOptions(argc, argv, &options))
+        return usage();
+
+    mkdir(options.work.c_str(), 0755);
+
+    // System libraries are not traced, allocations in them still are
+    std::ofstream filter(options.work + "/filter.yaml", std::ios::trunc);
+    filter << "image: {exclude: [\"^/lib\", \"^/usr/lib\", \"vdso\"]}" << std::endl;
+    filter.close();
+
+    printf("benchmark,setting,native_seconds,tool_seconds,slowdown,events,events_per_second,peak_rss_kb,database_bytes\n");
+
+    for (auto& target : targets)
+    {
+        if (options.only.empty() || std::find(options.only.begin(), options.only.end(), target.name) != options.only.end())
+            benchmark(options, target);
+    }
+
+    return 0;
+}
@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pin.H>
+
+#include "eventstream.h"
+#include "manager.h"
+
+/* Feeds synthetic trace buffers through Manager::bufferFull as the dynamic tool does, without Pin. Prints the events
+ * per second of every thread, only the time spent in bufferFull is counted. */
+
+struct Options
+{
+    std::string db;
+    DatabaseOptions databaseOptions;
+
+    bool aggregateCalls;
+    bool aggregateAccesses;
+    bool summarizeConflicts;
+
+    UINT32 threads;
+    UINT64 events;
+    UINT64 bufferEntries;
+
+    EventStreamOptions stream;
+};
+
+struct ThreadResult
+{
+    UINT64 events;
+    double seconds;
+};
+
+void feed(Manager* manager, const SyntheticProgram* program, const Options* options, THREADID tid, ThreadResult* result)
+{
+    manager->setUpThreadManager(tid);
+
+    EventStream stream(*program, options->stream, tid);
+    std::vector<BufferEntry> buffer(options->bufferEntries);
+    std::vector<AllocData> allocations;
+
+    result->events = 0;
+    result->seconds = 0;
+
+    while (true)
+    {
+        UINT64 room = buffer.size();
+
+        if (result->events >= options->events)
+            stream.end();
+        else
+            room = std::min(room, std::max(options->events - result->events, (UINT64)4));
+
+        allocations.clear();
+
+        UINT64 count = stream.fill(buffer.data(), room, allocations);
+
+        if (count == 0)
+            break;
+
+        // The allocation routines run before the buffer is full
+        for (auto& it : allocations)
+            manager->storeAllocation(tid, it);
+
+        auto begin = std::chrono::steady_clock::now();
+
+        manager->bufferFull(buffer.data(), count, tid);
+
+        result->seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        result->events += count;
+    }
+
+    manager->tearDownThreadManager(tid);
+}
+
+int usage()
+{
+    std::cerr << "Usage: pintool_eventbench [options]" << std::endl;
+    std::cerr << "  -db file                database written, default eventbench.db" << std::endl;
+    std::cerr << "  -db-mode file|memory    as for pintool_dynamic" << std::endl;
+    std::cerr << "  -cct, -aggregate-accesses, -summarize-conflicts" << std::endl;
+    std::cerr << "  -threads n              threads feeding buffers concurrently, default 1" << std::endl;
+    std::cerr << "  -events n               events per thread, default 1000000" << std::endl;
+    std::cerr << "  -buffer n               entries per buffer, default 65536" << std::endl;
+    std::cerr << "  -seed n" << std::endl;
+    std::cerr << "  -depth n                maximum call depth, default 16" << std::endl;
+    std::cerr << "  -calls percent          events calling or returning, default 10" << std::endl;
+    std::cerr << "  -globals bytes          global memory accessed, default 1048576" << std::endl;
+    std::cerr << "  -hot bytes -hot-percent percent" << std::endl;
+    std::cerr << "                          global accesses to the first bytes, default 4096 and 80" << std::endl;
+    std::cerr << "  -stack percent          accesses to the current frame, default 30" << std::endl;
+    std::cerr << "  -heap percent           accesses to live allocations, default 20" << std::endl;
+    std::cerr << "  -writes percent         default 30" << std::endl;
+    std::cerr << "  -allocations permille   events allocating, default 1" << std::endl;
+    std::cerr << "  -live n                 live allocations, default 1000" << std::endl;
+    std::cerr << "  -task-events n          events per section task, default 0 for no tags" << std::endl;
+    std::cerr << "  -section-tasks n        tasks per section, default 16" << std::endl;
+
+    return -1;
+}
+
+bool parseOptions(int argc, char* argv[], Options* options)
+{
+    options->db = "eventbench.db";
+    options->aggregateCalls = false;
+    options->aggregateAccesses = false;
+    options->summarizeConflicts = false;
+    options->threads = 1;
+    options->events = 1000000;
+    options->bufferEntries = 65536;
+
+    EventStreamOptions& stream = options->stream;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+
+        if (arg == "-cct")
+        {
+            options->aggregateCalls = true;
+            continue;
+        }
+        else if (arg == "-aggregate-accesses")
+        {
+            options->aggregateAccesses = true;
+            continue;
+        }
+        else if (arg == "-summarize-conflicts")
+        {
+            options->summarizeConflicts = true;
+            continue;
+        }
+
+        if (i + 1 >= argc)
+            return false;
+
+        std::string value = argv[++i];
+        UINT64 number = strtoull(value.c_str(), NULL, 10);
+
+        if (arg == "-db")
+            options->db = value;
+        else if (arg == "-db-mode")
+            options->databaseOptions.mode = parseDatabaseMode(value);
+        else if (arg == "-threads")
+            options->threads = number;
+        else if (arg == "-events")
+            options->events = number;
+        else if (arg == "-buffer")
+            options->bufferEntries = number;
+        else if (arg == "-seed")
+            stream.seed = number;
+        else if (arg == "-depth")
+            stream.maxDepth = number;
+        else if (arg == "-calls")
+            stream.callPercent = number;
+        else if (arg == "-globals")
+            stream.globalBytes = number;
+        else if (arg == "-hot")
+            stream.hotBytes = number;
+        else if (arg == "-hot-percent")
+            stream.hotPercent = number;
+        else if (arg == "-stack")
+            stream.stackPercent = number;
+        else if (arg == "-heap")
+            stream.heapPercent = number;
+        else if (arg == "-writes")
+            stream.writePercent = number;
+        else if (arg == "-allocations")
+            stream.allocationsPerMille = number;
+        else if (arg == "-live")
+            stream.liveAllocations = number;
+        else if (arg == "-task-events")
+            stream.taskEvents = number;
+        else if (arg == "-section-tasks")
+            stream.sectionTasks = number;
+        else
+            return false;
+    }
+
+    return options->threads > 0 && options->bufferEntries >= 4 && stream.maxDepth > 0 && stream.globalBytes >= 8 && stream.hotBytes >= 8 &&
+           stream.hotBytes <= stream.globalBytes;
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+
+    if (!parseOptions(argc, argv, &options))
+        return usage();
+
+    std::string source = options.db + ".source.yaml";
+    std::string filter = options.db + ".filter.yaml";
+
+    unlink(options.db.c_str());
+
+    {
+        SQLWriter writer(options.db, true);
+
+        writeSyntheticSource(source, writer);
+    }
+
+    std::ofstream filterFile(filter, std::ios::trunc);
+    filterFile << "{}" << std::endl;
+    filterFile.close();
+
+    std::vector<ThreadResult> results(options.threads);
+    double wall;
+
+    {
+        Manager manager(options.db, source, filter, options.databaseOptions);
+
+        manager.aggregateCalls = options.aggregateCalls;
+        manager.aggregateAccesses = options.aggregateAccesses;
+        manager.summarizeConflicts = options.summarizeConflicts;
+
+        SyntheticProgram program;
+        setUpSyntheticProgram(&manager, &program);
+
+        std::vector<std::thread> threads;
+
+        auto begin = std::chrono::steady_clock::now();
+
+        for (UINT32 i = 0; i < options.threads; i++)
+            threads.push_back(std::thread(feed, &manager, &program, &options, i, &results[i]));
+
+        for (auto& it : threads)
+            it.join();
+
+        wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    }
+
+    UINT64 total = 0;
+
+    printf("thread,events,seconds,events_per_second\n");
+
+    for (UINT32 i = 0; i < options.threads; i++)
+    {
+        printf("%u,%llu,%.3f,%.0f\n", i, (unsigned long long)results[i].events, results[i].seconds, results[i].events / results[i].seconds);
+        total += results[i].events;
+    }
+
+    printf("all,%llu,%.3f,%.0f\n", (unsigned long long)total, wall, total / wall);
+
+    return 0;
+}
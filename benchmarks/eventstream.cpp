@@ -0,0 +1,308 @@
+#include "eventstream.h"
+
+#include <fstream>
+
+#include "asm.h"
+
+/* Frames of the synthetic stack, the frame of depth 1 is the thread's first function */
+static const ADDRINT frameBytes = 128;
+static const ADDRINT globalBase = 0x10000000;
+static const ADDRINT tagBase = 0x400000;
+
+void writeSyntheticSource(const std::string& file, SQLWriter& writer)
+{
+    SourceLocation locations[3];
+
+    for (int i = 0; i < 3; i++)
+    {
+        locations[i].function = 1;
+        locations[i].line = i + 1;
+        locations[i].column = 0;
+
+        writer.insertSourceLocation(locations[i]);
+    }
+
+    std::ofstream source(file, std::ios::trunc);
+
+    source << "tags:" << std::endl;
+    source << "  - {name: synthetic, type: Section}" << std::endl;
+    source << "  - {name: syntheticTask, type: SectionTask}" << std::endl;
+    source << "tagInstructions:" << std::endl;
+    source << "  - {type: Start, location: " << locations[0].id << ", tag: 1}" << std::endl;
+    source << "  - {type: Stop, location: " << locations[1].id << ", tag: 1}" << std::endl;
+    source << "  - {type: Start, location: " << locations[2].id << ", tag: 2}" << std::endl;
+    source << "flags: {processAccessesByDefault: true, processCallsByDefault: true}" << std::endl;
+}
+
+void setUpSyntheticProgram(Manager* manager, SyntheticProgram* program)
+{
+    program->functions = 64;
+
+    for (int i = 0; i < 64; i++)
+    {
+        program->callSites.push_back(manager->locationDetails.size());
+        manager->locationDetails.push_back({1 + i % program->functions, i + 1, 0});
+    }
+
+    int location = manager->locationDetails.size();
+    manager->locationDetails.push_back({1, 0, 0});
+
+    // Streams keep pointers to the details, the vector must not grow afterwards
+    std::size_t first = manager->accessDetails.size();
+
+    manager->accessDetails.resize(first + 4);
+    manager->accessDetails[first].accesses.push_back({0, 8, true, false, StackOperand::None});
+    manager->accessDetails[first + 1].accesses.push_back({0, 8, false, true, StackOperand::None});
+    manager->accessDetails[first + 2].accesses.push_back({0, 8, true, false, StackOperand::Frame});
+    manager->accessDetails[first + 3].accesses.push_back({0, 8, false, true, StackOperand::Frame});
+
+    for (std::size_t i = first; i < first + 4; i++)
+        manager->accessDetails[i].location = location;
+
+    program->load = &manager->accessDetails[first];
+    program->store = &manager->accessDetails[first + 1];
+    program->stackLoad = &manager->accessDetails[first + 2];
+    program->stackStore = &manager->accessDetails[first + 3];
+
+    program->sectionStart = 0;
+    program->sectionStop = 0;
+    program->taskStart = 0;
+
+    for (auto& it : manager->tagInstructions)
+    {
+        const Tag& tag = manager->tagIdTagMap[it.tag];
+
+        if (tag.type == TagType::Section && it.type == TagInstructionType::Start)
+            program->sectionStart = it.id;
+        else if (tag.type == TagType::Section && it.type == TagInstructionType::Stop)
+            program->sectionStop = it.id;
+        else if (tag.type == TagType::SectionTask && it.type == TagInstructionType::Start)
+            program->taskStart = it.id;
+    }
+}
+
+EventStream::EventStream(const SyntheticProgram& program, const EventStreamOptions& options, THREADID tid) :
+    program(program), options(options)
+{
+    random = ((options.seed + tid) * 0x9e3779b97f4a7c15ULL) | 1;
+
+    // Later than the start of the thread manager, which subtracts its own start
+    tsc = rdtsc();
+
+    stackTop = 0x7f0000000000ULL - (ADDRINT)tid * 0x1000000;
+    heapBase = 0x600000000000ULL + ((ADDRINT)tid << 32);
+    heapNext = 0;
+
+    events = 0;
+    tasks = 0;
+    sectionRunning = false;
+    ending = false;
+}
+
+UINT64 EventStream::nextRandom()
+{
+    random ^= random << 13;
+    random ^= random >> 7;
+    random ^= random << 17;
+
+    return random;
+}
+
+UINT32 EventStream::percent()
+{
+    return nextRandom() % 100;
+}
+
+ADDRINT EventStream::frameBase(std::size_t depth)
+{
+    return stackTop - (depth - 1) * frameBytes - 16;
+}
+
+ADDRINT EventStream::frameTop(std::size_t depth)
+{
+    return stackTop - depth * frameBytes;
+}
+
+UINT64 EventStream::fill(BufferEntry* entries, UINT64 count, std::vector<AllocData>& allocations)
+{
+    UINT64 i = 0;
+
+    if (ending)
+    {
+        while (i < count && (sectionRunning || !callStack.empty()))
+        {
+            if (sectionRunning)
+            {
+                tag(entries, i, program.sectionStop);
+                sectionRunning = false;
+            }
+            else
+            {
+                ret(entries, i);
+            }
+        }
+
+        return i;
+    }
+
+    // A step takes at most two tags and a call
+    while (i + 4 <= count)
+    {
+        if (callStack.empty())
+        {
+            callEnter(entries, i);
+            continue;
+        }
+
+        if (options.taskEvents > 0 && program.taskStart != 0 && events % options.taskEvents == 0)
+        {
+            if (!sectionRunning || tasks == options.sectionTasks)
+            {
+                if (sectionRunning)
+                    tag(entries, i, program.sectionStop);
+
+                tag(entries, i, program.sectionStart);
+                sectionRunning = true;
+                tasks = 0;
+            }
+
+            tag(entries, i, program.taskStart);
+            tasks++;
+        }
+
+        events++;
+
+        if (nextRandom() % 1000 < options.allocationsPerMille)
+            allocate(allocations);
+
+        if (percent() < options.callPercent)
+        {
+            if (callStack.size() > 1 && (callStack.size() >= options.maxDepth || (nextRandom() & 1)))
+                ret(entries, i);
+            else
+                callEnter(entries, i);
+        }
+        else
+        {
+            access(entries, i);
+        }
+    }
+
+    return i;
+}
+
+void EventStream::end()
+{
+    ending = true;
+}
+
+void EventStream::callEnter(BufferEntry* entries, UINT64& i)
+{
+    if (!callStack.empty())
+    {
+        BufferEntry& call = entries[i++];
+
+        call.type = BuferEntryType::Call;
+        call.data.callInstruction.location = program.callSites[nextRandom() % program.callSites.size()];
+        call.data.callInstruction.tsc = tsc++;
+        call.data.callInstruction.rsp = frameTop(callStack.size());
+    }
+
+    callStack.push_back(1 + nextRandom() % program.functions);
+
+    BufferEntry& enter = entries[i++];
+
+    enter.type = BuferEntryType::CallEnter;
+    enter.data.callEnter.functionId = callStack.back();
+    enter.data.callEnter.tsc = tsc++;
+    enter.data.callEnter.rbp = frameBase(callStack.size());
+    enter.data.callEnter.rsp = frameTop(callStack.size());
+}
+
+void EventStream::ret(BufferEntry* entries, UINT64& i)
+{
+    BufferEntry& ret = entries[i++];
+
+    ret.type = BuferEntryType::Ret;
+    ret.data.ret.functionId = callStack.back();
+    ret.data.ret.tsc = tsc++;
+    ret.data.ret.rsp = frameTop(callStack.size());
+
+    callStack.pop_back();
+}
+
+void EventStream::tag(BufferEntry* entries, UINT64& i, int instruction)
+{
+    BufferEntry& tag = entries[i++];
+
+    tag.type = BuferEntryType::Tag;
+    tag.data.tag.tagId = instruction;
+    tag.data.tag.tsc = tsc++;
+    tag.data.tag.address = tagBase + instruction * 16;
+}
+
+void EventStream::access(BufferEntry* entries, UINT64& i)
+{
+    UINT32 region = percent();
+    ADDRINT address;
+    bool stack = region < options.stackPercent;
+
+    if (stack)
+    {
+        address = frameTop(callStack.size()) + nextRandom() % (frameBytes - 16);
+    }
+    else if (region < options.stackPercent + options.heapPercent && !live.empty())
+    {
+        const Allocation& allocation = live[nextRandom() % live.size()];
+
+        address = allocation.address + nextRandom() % allocation.size;
+    }
+    else
+    {
+        UINT64 bytes = percent() < options.hotPercent ? options.hotBytes : options.globalBytes;
+
+        address = globalBase + nextRandom() % bytes;
+    }
+
+    BufferEntry& memref = entries[i++];
+
+    bool write = percent() < options.writePercent;
+
+    memref.type = BuferEntryType::MemRef;
+    memref.data.memref.accessDetails = (ADDRINT)(stack ? (write ? program.stackStore : program.stackLoad) : (write ? program.store : program.load));
+    memref.data.memref.addresses[0] = address & ~(ADDRINT)7;
+    memref.data.memref.rsp = frameTop(callStack.size());
+    memref.data.memref.tsc = tsc++;
+}
+
+void EventStream::allocate(std::vector<AllocData>& allocations)
+{
+    AllocData data;
+
+    if (live.size() >= options.liveAllocations && !live.empty())
+    {
+        std::size_t index = nextRandom() % live.size();
+
+        data.type = AllocType::free;
+        data.tsc = tsc++;
+        data.address = live[index].address;
+
+        allocations.push_back(data);
+
+        live[index] = live.back();
+        live.pop_back();
+    }
+
+    UINT64 size = 16 + (nextRandom() % 4096 & ~(UINT64)15);
+
+    data.type = AllocType::malloc;
+    data.tsc = tsc++;
+    data.address = heapBase + heapNext;
+    data.malloc.size = size;
+
+    allocations.push_back(data);
+    live.push_back({data.address, size});
+
+    // 4 GB of heap per thread, old addresses are long freed when it wraps
+    heapNext = (heapNext + size) & 0xffffffffULL;
+}
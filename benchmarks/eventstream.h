@@ -0,0 +1,114 @@
+#ifndef EVENTSTREAM_H
+#define EVENTSTREAM_H
+
+#include <vector>
+
+#include <pin.H>
+
+#include "buffer.h"
+#include "manager.h"
+
+/* Synthetic trace buffers for feeding ThreadManager without Pin. Every thread gets its own stream, the same seed and
+ * options always give the same entries. */
+
+struct EventStreamOptions
+{
+    EventStreamOptions() : seed(1), maxDepth(16), callPercent(10), globalBytes(1 << 20), hotBytes(4096), hotPercent(80),
+        stackPercent(30), heapPercent(20), writePercent(30), allocationsPerMille(1), liveAllocations(1000), taskEvents(0),
+        sectionTasks(16) {}
+
+    UINT64 seed;
+
+    /* Events calling or returning, the depth wanders between 1 and maxDepth */
+    UINT32 maxDepth;
+    UINT32 callPercent;
+
+    /* Accesses go to the current frame, a live allocation or the globals, hotPercent of the global ones to the
+     * first hotBytes */
+    UINT64 globalBytes;
+    UINT64 hotBytes;
+    UINT32 hotPercent;
+    UINT32 stackPercent;
+    UINT32 heapPercent;
+    UINT32 writePercent;
+
+    /* Events allocating, once liveAllocations are live every allocation frees one first */
+    UINT32 allocationsPerMille;
+    UINT32 liveAllocations;
+
+    /* Events of a section task, 0 for no tags, a section is started again after sectionTasks tasks */
+    UINT64 taskEvents;
+    UINT64 sectionTasks;
+};
+
+/* Functions, call sites, access instructions and tag instructions the streams refer to, shared by all threads */
+struct SyntheticProgram
+{
+    int functions;
+    std::vector<int> callSites;
+
+    AccessInstructionDetails* load;
+    AccessInstructionDetails* store;
+
+    /* [rsp+disp] operands, used for the accesses to the current frame */
+    AccessInstructionDetails* stackLoad;
+    AccessInstructionDetails* stackStore;
+
+    /* Tag instructions of the source file written by writeSyntheticSource */
+    int sectionStart;
+    int sectionStop;
+    int taskStart;
+};
+
+/* Source file with a Section and a SectionTask tag, the database needs the source locations it refers to */
+void writeSyntheticSource(const std::string& file, SQLWriter& writer);
+
+/* Adds the call sites and access instructions to the manager, before any thread is set up */
+void setUpSyntheticProgram(Manager* manager, SyntheticProgram* program);
+
+class EventStream
+{
+public:
+    EventStream(const SyntheticProgram& program, const EventStreamOptions& options, THREADID tid);
+
+    /* Fills up to count entries, allocations happening before them are appended to allocations. After end() it only
+     * returns from the calls and stops the tags, 0 once everything is closed. */
+    UINT64 fill(BufferEntry* entries, UINT64 count, std::vector<AllocData>& allocations);
+    void end();
+private:
+    const SyntheticProgram& program;
+    EventStreamOptions options;
+
+    UINT64 random;
+    UINT64 nextRandom();
+    UINT32 percent();
+
+    UINT64 tsc;
+
+    std::vector<int> callStack;
+    ADDRINT stackTop;
+    ADDRINT frameBase(std::size_t depth);
+    ADDRINT frameTop(std::size_t depth);
+
+    struct Allocation {
+        ADDRINT address;
+        UINT64 size;
+    };
+
+    std::vector<Allocation> live;
+    ADDRINT heapBase;
+    UINT64 heapNext;
+
+    UINT64 events;
+    UINT64 tasks;
+    bool sectionRunning;
+    bool ending;
+
+    void callEnter(BufferEntry* entries, UINT64& i);
+    void ret(BufferEntry* entries, UINT64& i);
+    void tag(BufferEntry* entries, UINT64& i, int instruction);
+    void access(BufferEntry* entries, UINT64& i);
+    void allocate(std::vector<AllocData>& allocations);
+};
+
+#endif // EVENTSTREAM_H
@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Producer/consumer pipeline over a bounded queue, each stage thread runs a Pipeline with a task per item. The main
+ * thread then checks the results in a Section with a task per chunk.
+ * Lines ending in "// tag: name Type Start|Stop" become tag instructions in the benchmark driver. */
+
+class Queue
+{
+public:
+    Queue(std::size_t capacity) : capacity(capacity), closed(false) {}
+
+    void push(long value)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+
+        changed.wait(guard, [&]() { return values.size() < capacity; });
+
+        values.push_back(value);
+        changed.notify_all();
+    }
+
+    bool pop(long* value)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+
+        changed.wait(guard, [&]() { return !values.empty() || closed; });
+
+        if (values.empty())
+            return false;
+
+        *value = values.front();
+        values.pop_front();
+        changed.notify_all();
+
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+
+        closed = true;
+        changed.notify_all();
+    }
+
+private:
+    std::size_t capacity;
+    bool closed;
+
+    std::deque<long> values;
+    std::mutex mutex;
+    std::condition_variable changed;
+};
+
+__attribute__((noinline)) long produce(long item)
+{
+    long value = item;
+
+    for (int i = 0; i < 64; i++)
+        value = (value * 1103515245 + 12345) % 2147483648;
+
+    return value;
+}
+
+__attribute__((noinline)) long consume(long value, std::vector<long>& buckets)
+{
+    buckets[value % buckets.size()] += value;
+
+    return value % 7;
+}
+
+__attribute__((noinline)) long checkChunk(const std::vector<long>& buckets, std::size_t chunk, std::size_t chunks)
+{
+    long sum = 0;
+
+    for (std::size_t i = chunk; i < buckets.size(); i += chunks)
+        sum += buckets[i];
+
+    return sum;
+}
+
+__attribute__((noinline)) void stage(const char* name)
+{
+    asm volatile("" : : "r"(name) : "memory");
+}
+
+void producer(Queue* queue, long items)
+{
+    stage("produce"); // tag: produce Pipeline Start
+
+    for (long item = 0; item < items; item++)
+    {
+        long value = produce(item); // tag: produceItem PipelineTask Start
+
+        queue->push(value);
+    }
+
+    queue->close(); // tag: produce Pipeline Stop
+}
+
+void consumer(Queue* queue, std::vector<long>* buckets, long* checksum)
+{
+    stage("consume"); // tag: consume Pipeline Start
+
+    long value;
+
+    while (queue->pop(&value))
+        *checksum += consume(value, *buckets); // tag: consumeItem PipelineTask Start
+
+    stage("consumed"); // tag: consume Pipeline Stop
+}
+
+int main(int argc, char* argv[])
+{
+    long items = argc > 1 ? atol(argv[1]) : 100000;
+    std::size_t chunks = argc > 2 ? atoi(argv[2]) : 64;
+
+    Queue queue(256);
+    std::vector<long> buckets(4096);
+    long checksum = 0;
+
+    std::thread producerThread(producer, &queue, items);
+    std::thread consumerThread(consumer, &queue, &buckets, &checksum);
+
+    producerThread.join();
+    consumerThread.join();
+
+    stage("check"); // tag: check Section Start
+
+    for (std::size_t chunk = 0; chunk < chunks; chunk++)
+        checksum += checkChunk(buckets, chunk, chunks); // tag: checkChunk SectionTask Start
+
+    stage("checked"); // tag: check Section Stop
+
+    printf("%ld\n", checksum);
+
+    return 0;
+}
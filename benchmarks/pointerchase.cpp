@@ -0,0 +1,52 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+/* Pointer chasing through a random cycle of cache line sized nodes, every load misses and depends on the last one */
+
+struct Node
+{
+    Node* next;
+    long value;
+    char padding[48];
+};
+
+int main(int argc, char* argv[])
+{
+    long nodes = argc > 1 ? atol(argv[1]) : 100000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 10;
+
+    std::vector<Node> list(nodes);
+    std::vector<long> order(nodes);
+
+    for (long i = 0; i < nodes; i++)
+        order[i] = i;
+
+    srand(1);
+
+    for (long i = nodes - 1; i > 0; i--)
+        std::swap(order[i], order[rand() % (i + 1)]);
+
+    for (long i = 0; i < nodes; i++)
+    {
+        list[order[i]].next = &list[order[(i + 1) % nodes]];
+        list[order[i]].value = i;
+    }
+
+    long sum = 0;
+    Node* node = &list[0];
+
+    for (int round = 0; round < rounds; round++)
+    {
+        for (long i = 0; i < nodes; i++)
+        {
+            sum += node->value;
+            node = node->next;
+        }
+    }
+
+    printf("%ld\n", sum);
+
+    return 0;
+}
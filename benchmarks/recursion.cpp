@@ -0,0 +1,32 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Deep recursion, every frame writes and reads a small local array so stack references come and go */
+
+__attribute__((noinline)) long descend(int depth)
+{
+    volatile long locals[4];
+
+    for (int i = 0; i < 4; i++)
+        locals[i] = depth + i;
+
+    if (depth == 0)
+        return locals[0];
+
+    return descend(depth - 1) + locals[3];
+}
+
+int main(int argc, char* argv[])
+{
+    int depth = argc > 1 ? atoi(argv[1]) : 10000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 100;
+
+    long sum = 0;
+
+    for (int round = 0; round < rounds; round++)
+        sum += descend(depth);
+
+    printf("%ld\n", sum);
+
+    return 0;
+}
@@ -0,0 +1,27 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+/* Streaming triad over three arrays, sequential loads and stores in a single hot loop */
+
+__attribute__((noinline)) void triad(double* a, const double* b, const double* c, double scalar, long size)
+{
+    for (long i = 0; i < size; i++)
+        a[i] = b[i] + scalar * c[i];
+}
+
+int main(int argc, char* argv[])
+{
+    long size = argc > 1 ? atol(argv[1]) : 1000000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 10;
+
+    std::vector<double> a(size), b(size, 1.0), c(size, 2.0);
+
+    for (int round = 0; round < rounds; round++)
+        triad(a.data(), b.data(), c.data(), round, size);
+
+    printf("%f\n", a[size / 2]);
+
+    return 0;
+}
@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+/* Heavy tag churn, Sections of many tiny tasks that touch overlapping elements, so nearly every task conflicts.
+ * Lines ending in "// tag: name Type Start|Stop" become tag instructions in the benchmark driver. */
+
+__attribute__((noinline)) void reset(std::vector<long>& data)
+{
+    for (std::size_t i = 0; i < data.size(); i++)
+        data[i] = i;
+}
+
+__attribute__((noinline)) void touch(std::vector<long>& data, std::size_t task)
+{
+    std::size_t first = task % data.size();
+
+    data[first] += data[(first + 1) % data.size()];
+}
+
+__attribute__((noinline)) long finish(const std::vector<long>& data)
+{
+    long sum = 0;
+
+    for (std::size_t i = 0; i < data.size(); i++)
+        sum += data[i];
+
+    return sum;
+}
+
+int main(int argc, char* argv[])
+{
+    int sections = argc > 1 ? atoi(argv[1]) : 1000;
+    int tasks = argc > 2 ? atoi(argv[2]) : 100;
+
+    std::vector<long> data(64);
+    long checksum = 0;
+
+    for (int section = 0; section < sections; section++)
+    {
+        reset(data); // tag: churn Section Start
+
+        for (int task = 0; task < tasks; task++)
+            touch(data, task); // tag: churnTask SectionTask Start
+
+        checksum += finish(data); // tag: churn Section Stop
+    }
+
+    printf("%ld\n", checksum);
+
+    return 0;
+}
@@ -12,7 +12,10 @@ enum class BuferEntryType : UINT32
     Call,
     Ret,
     Tag,
-    MemRef
+    MemRef,
+    Loop,
+    MemRefAddresses,
+    BlockAccesses
 };
 
 struct CallInstructionBufferEntry
@@ -44,10 +47,45 @@ struct TagBufferEntry
     ADDRINT address;
 };
 
+enum class LoopEventType : UINT32
+{
+    Header,
+    Exit
+};
+
+struct LoopBufferEntry
+{
+    UINT32 loopId;
+    LoopEventType type;
+    UINT64 tsc;
+};
+
+/* Entries have the size of the largest one, so a MemRef entry only has room for the addresses of most instructions.
+ * The remaining ones of an instruction with more memory operands are in a MemRefAddresses entry right after it, as are
+ * the remaining registers of a BlockAccesses entry. */
+static const UINT32 memRefAddresses = 2;
+static const UINT32 moreMemRefAddresses = 5;
+static const UINT32 maxMemRefAddresses = memRefAddresses + moreMemRefAddresses;
+
 struct AccessInstructionBufferEntry
 {
     ADDRINT accessDetails;
-    ADDRINT addresses[7];
+    ADDRINT addresses[memRefAddresses];
+    UINT64 rsp;
+    UINT64 tsc;
+};
+
+struct AccessAddressesBufferEntry
+{
+    ADDRINT addresses[moreMemRefAddresses];
+};
+
+/* The memory instructions of a basic block recorded at its first one, their addresses are computed from the values of
+ * the registers they use, block points to the BlockAccessDetails */
+struct BlockAccessesBufferEntry
+{
+    ADDRINT block;
+    ADDRINT registers[memRefAddresses];
     UINT64 rsp;
     UINT64 tsc;
 };
@@ -89,6 +127,9 @@ union BufferEntryUnion
     RetBufferEntry ret;
     TagBufferEntry tag;
     AccessInstructionBufferEntry memref;
+    AccessAddressesBufferEntry memrefAddresses;
+    BlockAccessesBufferEntry blockAccesses;
+    LoopBufferEntry loop;
 };
 
 struct BufferEntry
@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <pin.H>
+
+#include "manager.h"
+#include "buffer.h"
+#include "asm.h"
+
+/* Call enter/ret throughput of ThreadManager, fed with buffers shaped like the ones dynamic.cpp fills */
+
+static const char* databaseFile = "calls.db";
+static const char* sourceFile = "calls.source.yaml";
+static const char* filterFile = "calls.filter.yaml";
+
+void writeInputs(int tags)
+{
+    unlink(databaseFile);
+
+    {
+        SQLWriter writer(databaseFile, true);
+
+        SourceLocation location;
+
+        location.function = 1;
+        location.line = 1;
+        location.column = 1;
+
+        writer.insertSourceLocation(location);
+    }
+
+    std::ofstream source(sourceFile);
+
+    source << "tags:" << std::endl;
+    for (int i = 0; i < tags; i++)
+        source << "  - {name: tag" << i << ", type: Simple}" << std::endl;
+
+    if (tags == 0)
+        source << "  []" << std::endl;
+
+    source << "tagInstructions:" << std::endl;
+    for (int i = 0; i < tags; i++)
+        source << "  - {type: Start, location: 1, tag: " << i + 1 << "}" << std::endl;
+
+    if (tags == 0)
+        source << "  []" << std::endl;
+
+    std::ofstream filter(filterFile);
+
+    filter << "{}" << std::endl;
+}
+
+BufferEntry callEntry(UINT64 tsc, UINT64 rsp)
+{
+    BufferEntry entry;
+
+    entry.type = BuferEntryType::Call;
+    entry.data.callInstruction.location = 0;
+    entry.data.callInstruction.tsc = tsc;
+    entry.data.callInstruction.rsp = rsp;
+
+    return entry;
+}
+
+BufferEntry callEnterEntry(UINT64 tsc, int function, UINT64 rsp)
+{
+    BufferEntry entry;
+
+    entry.type = BuferEntryType::CallEnter;
+    entry.data.callEnter.functionId = function;
+    entry.data.callEnter.tsc = tsc;
+    entry.data.callEnter.rbp = rsp;
+    entry.data.callEnter.rsp = rsp;
+
+    return entry;
+}
+
+BufferEntry retEntry(UINT64 tsc, int function, UINT64 rsp)
+{
+    BufferEntry entry;
+
+    entry.type = BuferEntryType::Ret;
+    entry.data.ret.functionId = function;
+    entry.data.ret.tsc = tsc;
+    entry.data.ret.rsp = rsp;
+
+    return entry;
+}
+
+// Chains of nested calls returning to the root frame, every call is a Call, CallEnter and Ret entry
+std::vector<BufferEntry> generateCalls(int depth, int chains, UINT64& tsc)
+{
+    std::vector<BufferEntry> entries;
+    const UINT64 stackTop = 0x7fff00000000;
+
+    entries.reserve(chains * depth * 3);
+
+    for (int chain = 0; chain < chains; chain++)
+    {
+        for (int d = 1; d <= depth; d++)
+        {
+            entries.push_back(callEntry(tsc++, stackTop - d * 64 + 32));
+            entries.push_back(callEnterEntry(tsc++, d + 1, stackTop - d * 64));
+        }
+
+        for (int d = depth; d >= 1; d--)
+        {
+            entries.push_back(retEntry(tsc++, d + 1, stackTop - d * 64));
+        }
+    }
+
+    return entries;
+}
+
+void benchmark(const std::string& name, bool aggregateCalls, int tags, int depth, int calls)
+{
+    writeInputs(tags);
+
+    DatabaseOptions options;
+    options.mode = DatabaseMode::Memory;
+    options.memoryLimit = 0;
+
+    Manager manager(databaseFile, sourceFile, filterFile, options);
+
+    manager.aggregateCalls = aggregateCalls;
+    manager.locationDetails.push_back((LocationDetails){1, 1, 1});
+    manager.setUpThreadManager(0);
+
+    UINT64 tsc = 1;
+
+    // The root frame never returns, tags are started inside it so every call copies their instances
+    std::vector<BufferEntry> start;
+
+    start.push_back(callEnterEntry(tsc++, 1, 0x7fff00000000));
+
+    for (int i = 0; i < tags; i++)
+    {
+        BufferEntry entry;
+
+        entry.type = BuferEntryType::Tag;
+        entry.data.tag.tagId = manager.tagInstructions[i].id;
+        entry.data.tag.tsc = tsc++;
+        entry.data.tag.address = i;
+
+        start.push_back(entry);
+    }
+
+    manager.bufferFull(start.data(), start.size(), 0);
+
+    std::vector<BufferEntry> entries = generateCalls(depth, 100000 / (3 * depth), tsc);
+    int callsPerBuffer = entries.size() / 3;
+
+    UINT64 cycles = 0;
+    int done = 0;
+
+    while (done < calls)
+    {
+        UINT64 begin = rdtsc();
+        manager.bufferFull(entries.data(), entries.size(), 0);
+        cycles += rdtsc() - begin;
+
+        done += callsPerBuffer;
+    }
+
+    BufferEntry end = retEntry(tsc++, 1, 0x7fff00000000);
+    manager.bufferFull(&end, 1, 0);
+
+    manager.tearDownThreadManager(0);
+
+    std::cout << name << ": " << done << " calls, " << (double)cycles / done << " cycles/call" << std::endl;
+}
+
+int main(int argc, char * argv[])
+{
+    PIN_InitSymbols();
+
+    if (PIN_Init(argc, argv)) return -1;
+
+    benchmark("cct", true, 0, 8, 10000000);
+    benchmark("cct with 3 tags", true, 3, 8, 10000000);
+    benchmark("calls", false, 0, 8, 1000000);
+    benchmark("calls with 3 tags", false, 3, 8, 1000000);
+
+    PIN_StartProgram();
+
+    return 0;
+}
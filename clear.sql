@@ -1,6 +1,9 @@
 DELETE FROM Access;
 DELETE FROM Call;
+DELETE FROM CallTagInstance;
+DELETE FROM Conflict;
 DELETE FROM Instruction;
+DELETE FROM InstructionTagInstance;
 DELETE FROM Loop;
 DELETE FROM LoopExecution;
 DELETE FROM LoopIteration;
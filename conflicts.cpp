@@ -0,0 +1,102 @@
+#include "conflicts.h"
+
+#include <algorithm>
+
+void ConflictDetector::record(int instance, int parent, ADDRINT address, int reference, int access, AccessType type, std::vector<Conflict>& conflicts)
+{
+    ADDRINT key = address >> 3;
+    std::vector<ShadowEntry>& granule = shadow[key];
+    UINT8 offset = address & 7;
+
+    bool found = false;
+    bool shared = false;
+    std::size_t insertAt = granule.size();
+
+    for (std::size_t i = 0; i < granule.size(); i++)
+    {
+        const ShadowEntry& entry = granule[i];
+
+        if (insertAt == granule.size() && entry.instance > instance)
+            insertAt = i;
+
+        if (entry.offset != offset || entry.reference != reference)
+            continue;
+
+        if (entry.instance == instance)
+            found = true;
+        else
+            shared = true;
+    }
+
+    // Only the first access of an instance is kept
+    if (!found)
+    {
+        ShadowEntry entry = {instance, reference, access, type, offset};
+        granule.insert(granule.begin() + insertAt, entry);
+
+        std::vector<ADDRINT>& footprint = footprints[instance];
+
+        if (footprint.empty() || footprint.back() != key)
+            footprint.push_back(key);
+    }
+
+    if (!shared)
+        return;
+
+    for (auto& entry : granule)
+    {
+        if (entry.offset != offset || entry.reference != reference)
+            continue;
+
+        if (entry.instance != instance && (type == AccessType::Write || entry.type == AccessType::Write) && entry.instance != parent)
+        {
+            Conflict c;
+
+            c.tagInstance1 = instance;
+            c.tagInstance2 = entry.instance;
+            c.access1 = access;
+            c.access2 = entry.access;
+            c.type1 = type;
+            c.type2 = entry.type;
+
+            conflicts.push_back(c);
+        }
+    }
+}
+
+void ConflictDetector::close(const std::set<int>& instances)
+{
+    for (int instance : instances)
+    {
+        auto footprint = footprints.find(instance);
+
+        if (footprint == footprints.end())
+            continue;
+
+        for (ADDRINT key : footprint->second)
+        {
+            auto it = shadow.find(key);
+
+            // Already emptied through an earlier entry of the footprint
+            if (it == shadow.end())
+                continue;
+
+            std::vector<ShadowEntry>& granule = it->second;
+
+            granule.erase(std::remove_if(granule.begin(), granule.end(), [&] (const ShadowEntry& entry)
+            {
+                return entry.instance == instance;
+            }), granule.end());
+
+            if (granule.empty())
+                shadow.erase(it);
+        }
+
+        footprints.erase(footprint);
+    }
+}
+
+std::size_t ConflictDetector::size() const
+{
+    return shadow.size();
+}
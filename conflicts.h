@@ -0,0 +1,41 @@
+#ifndef CONFLICTS_H
+#define CONFLICTS_H
+
+#include <unordered_map>
+#include <vector>
+#include <set>
+
+#include <pin.H>
+
+#include "entities.h"
+
+/* First access of a task instance to an address of a reference */
+struct ShadowEntry
+{
+    int instance;
+    int reference;
+    int access;
+    AccessType type;
+    UINT8 offset;
+};
+
+/*
+ * Shadow memory for tag conflict detection. Addresses are grouped in 8 byte
+ * granules, each holding the accesses of the live task instances sorted by
+ * instance so conflicts are reported in the same order as before.
+ */
+class ConflictDetector
+{
+public:
+    void record(int instance, int parent, ADDRINT address, int reference, int access, AccessType type, std::vector<Conflict>& conflicts);
+    void close(const std::set<int>& instances);
+
+    std::size_t size() const;
+private:
+    std::unordered_map<ADDRINT, std::vector<ShadowEntry> > shadow;
+
+    /* Granules holding an entry of each instance, so closing costs only its own footprint */
+    std::unordered_map<int, std::vector<ADDRINT> > footprints;
+};
+
+#endif // CONFLICTS_H
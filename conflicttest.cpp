@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <iostream>
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include <pin.H>
+
+#include "conflicts.h"
+#include "asm.h"
+
+/* The nested map detector the shadow memory replaced, kept as reference */
+class MapConflictDetector
+{
+public:
+    void record(int instance, int parent, ADDRINT address, int reference, int access, AccessType accessType, std::vector<Conflict>& conflicts)
+    {
+        auto it = tagAccessingReference.find(reference);
+
+        if (accessType == AccessType::Write || tagAccessingReference[reference][address].find(instance) == tagAccessingReference[reference][address].end())
+            tagAccessingReference[reference][address].insert(std::make_pair(instance, std::make_pair(access, accessType)));
+
+        if (it == tagAccessingReference.end())
+            return;
+
+        auto it2 = it->second.find(address);
+
+        if (it2->second.size() == 1)
+            return;
+
+        for(auto it3 : it2->second) {
+            if (it3.first != instance && (accessType == AccessType::Write || it3.second.second == AccessType::Write) && it3.first != parent) {
+                 Conflict c;
+
+                 c.tagInstance1 = instance;
+                 c.tagInstance2 = it3.first;
+                 c.access2 = it3.second.first;
+                 c.access1 = access;
+
+                 conflicts.push_back(c);
+            }
+        }
+    }
+
+    void close(const std::set<int>& tagInstances)
+    {
+        for(auto& it1: tagAccessingReference) {
+            for(auto& it2: it1.second) {
+                for(auto& it3: tagInstances) {
+                    it2.second.erase(it3);
+                }
+            }
+        }
+    }
+private:
+    std::map<int, std::map<ADDRINT, std::map<int, std::pair<int, AccessType> >>> tagAccessingReference;
+};
+
+struct SyntheticAccess
+{
+    int instance;
+    int parent;
+    ADDRINT address;
+    int reference;
+    AccessType type;
+};
+
+/*
+ * A pipeline of sections, each running a number of task instances. Every task
+ * streams over its own slice of a buffer, reads a shared table and updates a
+ * shared counter. With a growing buffer every section touches new memory, so
+ * retiring instances has to stay proportional to their own footprint.
+ */
+void generatePipeline(std::vector<SyntheticAccess>& accesses, std::vector<std::pair<size_t, std::set<int> > >& closes, int sections, int tasks, int accessesPerTask, bool growing)
+{
+    const ADDRINT buffer = 0x10000000;
+    const ADDRINT table = 0x20000000;
+    const ADDRINT counter = 0x30000000;
+
+    int instance = 1;
+
+    for (int section = 0; section < sections; section++)
+    {
+        int parent = instance++;
+        std::set<int> children;
+
+        for (int task = 0; task < tasks; task++)
+        {
+            int id = instance++;
+            children.insert(id);
+
+            for (int i = 0; i < accessesPerTask; i++)
+            {
+                switch (i % 4)
+                {
+                case 0:
+                    accesses.push_back({id, parent, table + (ADDRINT)(rand() % 256) * 8, 2, AccessType::Read});
+                    break;
+                case 1:
+                    accesses.push_back({id, parent, counter, 3, AccessType::Read});
+                    accesses.push_back({id, parent, counter, 3, AccessType::Write});
+                    break;
+                default:
+                    accesses.push_back({id, parent, buffer + (ADDRINT)(((growing ? section * tasks : 0) + task) * accessesPerTask + i) * 8, 1, (i % 2) ? AccessType::Write : AccessType::Read});
+                    break;
+                }
+            }
+        }
+
+        closes.push_back(std::make_pair(accesses.size(), children));
+    }
+}
+
+template <typename Detector>
+UINT64 run(Detector& detector, const std::vector<SyntheticAccess>& accesses, const std::vector<std::pair<size_t, std::set<int> > >& closes, UINT64& conflictCount, UINT64& checksum)
+{
+    std::vector<Conflict> conflicts;
+    size_t nextClose = 0;
+
+    UINT64 start = rdtsc();
+
+    for (size_t i = 0; i < accesses.size(); i++)
+    {
+        const SyntheticAccess& a = accesses[i];
+
+        detector.record(a.instance, a.parent, a.address, a.reference, i, a.type, conflicts);
+
+        for (auto& c : conflicts)
+        {
+            conflictCount++;
+            checksum = checksum * 31 + ((UINT64)c.tagInstance1 << 40) + ((UINT64)c.tagInstance2 << 20) + c.access1 * 7 + c.access2;
+        }
+
+        conflicts.clear();
+
+        if (nextClose < closes.size() && closes[nextClose].first == i + 1)
+            detector.close(closes[nextClose++].second);
+    }
+
+    return rdtsc() - start;
+}
+
+void benchmark(const char* name, int sections, int tasks, int accessesPerTask, bool growing)
+{
+    std::vector<SyntheticAccess> accesses;
+    std::vector<std::pair<size_t, std::set<int> > > closes;
+
+    generatePipeline(accesses, closes, sections, tasks, accessesPerTask, growing);
+
+    UINT64 mapConflicts = 0, mapChecksum = 0;
+    UINT64 shadowConflicts = 0, shadowChecksum = 0;
+
+    MapConflictDetector mapDetector;
+    UINT64 mapCycles = run(mapDetector, accesses, closes, mapConflicts, mapChecksum);
+
+    ConflictDetector shadowDetector;
+    UINT64 shadowCycles = run(shadowDetector, accesses, closes, shadowConflicts, shadowChecksum);
+
+    std::cout << name << ": " << accesses.size() << " accesses" << std::endl;
+    std::cout << "map: " << (double)mapCycles / accesses.size() << " cycles/access, " << mapConflicts << " conflicts" << std::endl;
+    std::cout << "shadow: " << (double)shadowCycles / accesses.size() << " cycles/access, " << shadowConflicts << " conflicts" << std::endl;
+
+    if (mapConflicts != shadowConflicts || mapChecksum != shadowChecksum)
+        std::cout << "Conflicts differ" << std::endl;
+}
+
+int main(int argc, char * argv[])
+{
+    PIN_Init(argc, argv);
+
+    benchmark("pipeline", 200, 100, 100, false);
+    benchmark("growing pipeline", 100, 25, 100, true);
+
+    PIN_StartProgram();
+
+    return 0;
+}
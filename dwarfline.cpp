@@ -0,0 +1,731 @@
+#include "dwarfline.h"
+
+#include <algorithm>
+
+#include "elffile.h"
+
+namespace
+{
+
+/* Little endian reader over a section, reads past the end return 0 and set overflow */
+class Reader
+{
+public:
+    Reader(const std::string& section, std::size_t offset, std::size_t end) : section(section), offset(offset), end(std::min(end, section.size())), overflow(false) {}
+
+    std::uint64_t fixed(int bytes)
+    {
+        if (!available(bytes))
+            return 0;
+
+        std::uint64_t value = 0;
+
+        for (int i = 0; i < bytes; i++)
+            value |= (std::uint64_t)(unsigned char)section[offset + i] << (8 * i);
+
+        offset += bytes;
+
+        return value;
+    }
+
+    std::uint64_t uleb()
+    {
+        std::uint64_t value = 0;
+        int shift = 0;
+
+        while (available(1))
+        {
+            unsigned char byte = section[offset++];
+
+            if (shift < 64)
+                value |= (std::uint64_t)(byte & 0x7f) << shift;
+
+            shift += 7;
+
+            if (!(byte & 0x80))
+                return value;
+        }
+
+        return 0;
+    }
+
+    std::int64_t sleb()
+    {
+        std::int64_t value = 0;
+        int shift = 0;
+
+        while (available(1))
+        {
+            unsigned char byte = section[offset++];
+
+            if (shift < 64)
+                value |= (std::int64_t)(byte & 0x7f) << shift;
+
+            shift += 7;
+
+            if (!(byte & 0x80))
+            {
+                if (shift < 64 && (byte & 0x40))
+                    value |= -((std::int64_t)1 << shift);
+
+                return value;
+            }
+        }
+
+        return 0;
+    }
+
+    std::string string()
+    {
+        std::size_t terminator = section.find('\0', offset);
+
+        if (terminator == std::string::npos || terminator >= end)
+        {
+            overflow = true;
+            offset = end;
+            return "";
+        }
+
+        std::string value = section.substr(offset, terminator - offset);
+
+        offset = terminator + 1;
+
+        return value;
+    }
+
+    void skip(std::uint64_t bytes)
+    {
+        if (available(bytes))
+            offset += bytes;
+    }
+
+    bool available(std::uint64_t bytes)
+    {
+        if (offset > end || bytes > end - offset)
+        {
+            overflow = true;
+            offset = end;
+            return false;
+        }
+
+        return true;
+    }
+
+    bool done() const
+    {
+        return overflow || offset >= end;
+    }
+
+    const std::string& section;
+    std::size_t offset;
+    std::size_t end;
+    bool overflow;
+};
+
+std::string stringAt(const std::string& section, std::uint64_t offset)
+{
+    if (offset >= section.size())
+        return "";
+
+    return std::string(section.c_str() + offset);
+}
+
+/* DW_FORM values used in .debug_info and DWARF 5 line headers */
+enum Form
+{
+    FormAddr = 0x01, FormBlock2 = 0x03, FormBlock4 = 0x04, FormData2 = 0x05, FormData4 = 0x06, FormData8 = 0x07,
+    FormString = 0x08, FormBlock = 0x09, FormBlock1 = 0x0a, FormData1 = 0x0b, FormFlag = 0x0c, FormSdata = 0x0d,
+    FormStrp = 0x0e, FormUdata = 0x0f, FormRefAddr = 0x10, FormRef1 = 0x11, FormRef2 = 0x12, FormRef4 = 0x13,
+    FormRef8 = 0x14, FormRefUdata = 0x15, FormIndirect = 0x16, FormSecOffset = 0x17, FormExprloc = 0x18,
+    FormFlagPresent = 0x19, FormStrx = 0x1a, FormAddrx = 0x1b, FormRefSup4 = 0x1c, FormStrpSup = 0x1d,
+    FormData16 = 0x1e, FormLineStrp = 0x1f, FormRefSig8 = 0x20, FormImplicitConst = 0x21, FormLoclistx = 0x22,
+    FormRnglistx = 0x23, FormRefSup8 = 0x24, FormStrx1 = 0x25, FormStrx2 = 0x26, FormStrx3 = 0x27,
+    FormStrx4 = 0x28, FormAddrx1 = 0x29, FormAddrx2 = 0x2a, FormAddrx3 = 0x2b, FormAddrx4 = 0x2c
+};
+
+struct FormValue
+{
+    std::uint64_t number;
+    std::string text;
+    bool isText;
+};
+
+/* Reads an attribute value, strings are resolved, everything else that is not a number is skipped */
+bool readForm(Reader& reader, std::uint64_t form, int offsetSize, int addressSize, int version, const std::string& str, const std::string& lineStr, FormValue* value)
+{
+    value->number = 0;
+    value->isText = false;
+
+    switch (form)
+    {
+    case FormAddr:
+        value->number = reader.fixed(addressSize);
+        break;
+    case FormData1: case FormRef1: case FormFlag: case FormStrx1: case FormAddrx1:
+        value->number = reader.fixed(1);
+        break;
+    case FormData2: case FormRef2: case FormStrx2: case FormAddrx2:
+        value->number = reader.fixed(2);
+        break;
+    case FormStrx3: case FormAddrx3:
+        value->number = reader.fixed(3);
+        break;
+    case FormData4: case FormRef4: case FormRefSup4: case FormStrx4: case FormAddrx4:
+        value->number = reader.fixed(4);
+        break;
+    case FormData8: case FormRef8: case FormRefSig8: case FormRefSup8:
+        value->number = reader.fixed(8);
+        break;
+    case FormData16:
+        reader.skip(16);
+        break;
+    case FormSdata:
+        value->number = reader.sleb();
+        break;
+    case FormUdata: case FormRefUdata: case FormStrx: case FormAddrx: case FormLoclistx: case FormRnglistx:
+        value->number = reader.uleb();
+        break;
+    case FormString:
+        value->text = reader.string();
+        value->isText = true;
+        break;
+    case FormStrp:
+        value->text = stringAt(str, reader.fixed(offsetSize));
+        value->isText = true;
+        break;
+    case FormLineStrp:
+        value->text = stringAt(lineStr, reader.fixed(offsetSize));
+        value->isText = true;
+        break;
+    case FormStrpSup: case FormSecOffset:
+        value->number = reader.fixed(offsetSize);
+        break;
+    case FormRefAddr:
+        value->number = reader.fixed(version <= 2 ? addressSize : offsetSize);
+        break;
+    case FormBlock1:
+        reader.skip(reader.fixed(1));
+        break;
+    case FormBlock2:
+        reader.skip(reader.fixed(2));
+        break;
+    case FormBlock4:
+        reader.skip(reader.fixed(4));
+        break;
+    case FormBlock: case FormExprloc:
+        reader.skip(reader.uleb());
+        break;
+    case FormFlagPresent: case FormImplicitConst:
+        break;
+    case FormIndirect:
+        return readForm(reader, reader.uleb(), offsetSize, addressSize, version, str, lineStr, value);
+    default:
+        return false;
+    }
+
+    return !reader.overflow;
+}
+
+std::string joinPath(const std::string& directory, const std::string& name)
+{
+    if (name.empty() || name[0] == '/' || directory.empty())
+        return name;
+
+    if (directory[directory.size() - 1] == '/')
+        return directory + name;
+
+    return directory + "/" + name;
+}
+
+}
+
+LineTable::LineTable(const ElfFile& elf)
+{
+    std::string line = elf.section(".debug_line");
+
+    if (line.empty())
+        return;
+
+    std::string str = elf.section(".debug_str");
+    std::string lineStr = elf.section(".debug_line_str");
+
+    parseCompilationDirectories(elf.section(".debug_info"), elf.section(".debug_abbrev"), str, lineStr);
+
+    std::size_t offset = 0;
+
+    while (offset < line.size())
+    {
+        std::size_t next;
+
+        parseProgram(line, offset, str, lineStr, &next);
+
+        if (next <= offset)
+            break;
+
+        offset = next;
+    }
+
+    std::stable_sort(table.begin(), table.end(), [](const LineRow& a, const LineRow& b)
+    {
+        return a.address < b.address;
+    });
+}
+
+void LineTable::parseCompilationDirectories(const std::string& info, const std::string& abbrev, const std::string& str, const std::string& lineStr)
+{
+    const std::uint64_t AttributeStmtList = 0x10;
+    const std::uint64_t AttributeCompDir = 0x1b;
+
+    std::size_t offset = 0;
+
+    while (offset + 4 <= info.size())
+    {
+        Reader reader(info, offset, info.size());
+
+        int offsetSize = 4;
+        std::uint64_t length = reader.fixed(4);
+
+        if (length == 0xffffffff)
+        {
+            offsetSize = 8;
+            length = reader.fixed(8);
+        }
+
+        std::size_t end = reader.offset + length;
+
+        if (length == 0 || end > info.size())
+            break;
+
+        offset = end;
+        reader.end = end;
+
+        int version = reader.fixed(2);
+        int addressSize;
+        std::uint64_t abbrevOffset;
+
+        if (version >= 5)
+        {
+            int unitType = reader.fixed(1);
+
+            addressSize = reader.fixed(1);
+            abbrevOffset = reader.fixed(offsetSize);
+
+            // Only full and partial units have the attributes directly after the header
+            if (unitType != 0x01 && unitType != 0x03)
+                continue;
+        }
+        else
+        {
+            abbrevOffset = reader.fixed(offsetSize);
+            addressSize = reader.fixed(1);
+        }
+
+        std::uint64_t code = reader.uleb();
+
+        if (code == 0 || abbrevOffset >= abbrev.size())
+            continue;
+
+        // Find the abbreviation of the unit DIE
+        Reader abbreviations(abbrev, abbrevOffset, abbrev.size());
+        bool found = false;
+
+        while (!abbreviations.done())
+        {
+            std::uint64_t entry = abbreviations.uleb();
+
+            if (entry == 0)
+                break;
+
+            abbreviations.uleb();
+            abbreviations.fixed(1);
+
+            if (entry == code)
+            {
+                found = true;
+                break;
+            }
+
+            while (!abbreviations.done())
+            {
+                std::uint64_t attribute = abbreviations.uleb();
+                std::uint64_t form = abbreviations.uleb();
+
+                if (form == FormImplicitConst)
+                    abbreviations.sleb();
+
+                if (attribute == 0 && form == 0)
+                    break;
+            }
+        }
+
+        if (!found)
+            continue;
+
+        bool hasStmtList = false;
+        std::uint64_t stmtList = 0;
+        std::string compDir;
+
+        while (!abbreviations.done() && !reader.done())
+        {
+            std::uint64_t attribute = abbreviations.uleb();
+            std::uint64_t form = abbreviations.uleb();
+
+            if (form == FormImplicitConst)
+                abbreviations.sleb();
+
+            if (attribute == 0 && form == 0)
+                break;
+
+            FormValue value;
+
+            if (!readForm(reader, form, offsetSize, addressSize, version, str, lineStr, &value))
+                break;
+
+            if (attribute == AttributeStmtList)
+            {
+                hasStmtList = true;
+                stmtList = value.number;
+            }
+            else if (attribute == AttributeCompDir && value.isText)
+            {
+                compDir = value.text;
+            }
+        }
+
+        if (hasStmtList && !compDir.empty())
+            compilationDirectories.push_back(std::make_pair(stmtList, compDir));
+    }
+
+    std::sort(compilationDirectories.begin(), compilationDirectories.end());
+}
+
+void LineTable::parseProgram(const std::string& section, std::size_t offset, const std::string& str, const std::string& lineStr, std::size_t* next)
+{
+    Reader reader(section, offset, section.size());
+
+    int offsetSize = 4;
+    std::uint64_t length = reader.fixed(4);
+
+    if (length == 0xffffffff)
+    {
+        offsetSize = 8;
+        length = reader.fixed(8);
+    }
+
+    if (reader.overflow || length > section.size() - reader.offset)
+    {
+        *next = section.size();
+        return;
+    }
+
+    *next = reader.offset + length;
+    reader.end = *next;
+
+    int version = reader.fixed(2);
+    int addressSize = 8;
+
+    if (version < 2 || version > 5)
+        return;
+
+    if (version >= 5)
+    {
+        addressSize = reader.fixed(1);
+        reader.fixed(1);
+    }
+
+    std::uint64_t headerLength = reader.fixed(offsetSize);
+    std::size_t program = reader.offset + headerLength;
+
+    int minimumInstructionLength = reader.fixed(1);
+
+    if (version >= 4)
+        reader.fixed(1);
+
+    bool defaultIsStmt = reader.fixed(1) != 0;
+    int lineBase = (std::int8_t)reader.fixed(1);
+    int lineRange = reader.fixed(1);
+    int opcodeBase = reader.fixed(1);
+
+    (void)defaultIsStmt;
+
+    if (lineRange == 0 || opcodeBase == 0)
+        return;
+
+    std::vector<int> opcodeLengths(opcodeBase, 0);
+
+    for (int i = 1; i < opcodeBase; i++)
+        opcodeLengths[i] = reader.fixed(1);
+
+    std::string compDir;
+
+    auto dir = std::lower_bound(compilationDirectories.begin(), compilationDirectories.end(), std::make_pair((std::uint64_t)offset, std::string()));
+
+    if (dir != compilationDirectories.end() && dir->first == offset)
+        compDir = dir->second;
+
+    std::vector<std::string> directories;
+
+    // Indexes into files, file numbers start at 1 before DWARF 5 and at 0 since
+    std::vector<int> programFiles;
+
+    if (version < 5)
+    {
+        directories.push_back(compDir);
+
+        while (!reader.done())
+        {
+            std::string directory = reader.string();
+
+            if (directory.empty())
+                break;
+
+            directories.push_back(joinPath(compDir, directory));
+        }
+
+        programFiles.push_back(-1);
+
+        while (!reader.done())
+        {
+            std::string name = reader.string();
+
+            if (name.empty())
+                break;
+
+            std::uint64_t directory = reader.uleb();
+            reader.uleb();
+            reader.uleb();
+
+            files.push_back(joinPath(directory < directories.size() ? directories[directory] : "", name));
+            programFiles.push_back(files.size() - 1);
+        }
+    }
+    else
+    {
+        const std::uint64_t ContentPath = 1;
+        const std::uint64_t ContentDirectoryIndex = 2;
+
+        for (int list = 0; list < 2; list++)
+        {
+            std::vector<std::pair<std::uint64_t, std::uint64_t> > format(reader.fixed(1));
+
+            for (auto& it : format)
+            {
+                it.first = reader.uleb();
+                it.second = reader.uleb();
+            }
+
+            std::uint64_t count = reader.uleb();
+
+            for (std::uint64_t i = 0; i < count && !reader.done(); i++)
+            {
+                std::string path;
+                std::uint64_t directory = 0;
+
+                for (auto& it : format)
+                {
+                    FormValue value;
+
+                    if (!readForm(reader, it.second, offsetSize, addressSize, version, str, lineStr, &value))
+                        return;
+
+                    if (it.first == ContentPath)
+                        path = value.text;
+                    else if (it.first == ContentDirectoryIndex)
+                        directory = value.number;
+                }
+
+                if (list == 0)
+                {
+                    directories.push_back(directories.empty() ? joinPath(compDir, path) : joinPath(directories[0], path));
+                }
+                else
+                {
+                    files.push_back(joinPath(directory < directories.size() ? directories[directory] : "", path));
+                    programFiles.push_back(files.size() - 1);
+                }
+            }
+        }
+    }
+
+    reader.offset = program;
+
+    LineRow row;
+    bool sequence = false;
+    std::size_t sequenceStart = table.size();
+
+    std::uint64_t address = 0;
+    std::uint64_t file = 1;
+    std::int64_t line = 1;
+    std::uint64_t column = 0;
+
+    auto emit = [&]()
+    {
+        // The previous row of the sequence ends where this one starts
+        if (sequence && table.size() > sequenceStart)
+            table.back().end = address;
+
+        row.address = address;
+        row.end = address;
+        row.file = file < programFiles.size() ? programFiles[file] : -1;
+        row.line = (int)line;
+        row.column = (int)column;
+
+        table.push_back(row);
+        sequence = true;
+    };
+
+    auto reset = [&]()
+    {
+        address = 0;
+        file = 1;
+        line = 1;
+        column = 0;
+        sequence = false;
+        sequenceStart = table.size();
+    };
+
+    while (!reader.done())
+    {
+        int opcode = reader.fixed(1);
+
+        if (opcode >= opcodeBase)
+        {
+            int adjusted = opcode - opcodeBase;
+
+            address += (adjusted / lineRange) * minimumInstructionLength;
+            line += lineBase + adjusted % lineRange;
+            emit();
+            continue;
+        }
+
+        switch (opcode)
+        {
+        case 0:
+        {
+            std::uint64_t size = reader.uleb();
+            std::size_t end = reader.offset + size;
+
+            if (size == 0)
+                break;
+
+            int extended = reader.fixed(1);
+
+            if (extended == 1)
+            {
+                // End of sequence, the last row only marks the end address
+                if (sequence && table.size() > sequenceStart)
+                    table.back().end = address;
+
+                reset();
+            }
+            else if (extended == 2)
+            {
+                address = reader.fixed(size - 1);
+            }
+
+            reader.offset = end;
+            break;
+        }
+        case 1:
+            emit();
+            break;
+        case 2:
+            address += reader.uleb() * minimumInstructionLength;
+            break;
+        case 3:
+            line += reader.sleb();
+            break;
+        case 4:
+            file = reader.uleb();
+            break;
+        case 5:
+            column = reader.uleb();
+            break;
+        case 8:
+            address += ((255 - opcodeBase) / lineRange) * minimumInstructionLength;
+            break;
+        case 9:
+            address += reader.fixed(2);
+            break;
+        case 6: case 7: case 10: case 11:
+            break;
+        default:
+            for (int i = 0; i < opcodeLengths[opcode]; i++)
+                reader.uleb();
+            break;
+        }
+    }
+
+    // A sequence without an end has no extent for its last row
+    if (sequence && table.size() > sequenceStart)
+        table.back().end = table.back().address;
+}
+
+const LineRow* LineTable::find(std::uint64_t address) const
+{
+    auto it = std::upper_bound(table.begin(), table.end(), address, [](std::uint64_t address, const LineRow& row)
+    {
+        return address < row.address;
+    });
+
+    // Rows from overlapping sequences can be interleaved, look back for one that covers the address
+    while (it != table.begin())
+    {
+        --it;
+
+        if (address < it->end)
+            return &*it;
+
+        if (it->address != it->end)
+            return NULL;
+    }
+
+    return NULL;
+}
+
+void LineTable::lookup(std::uint64_t address, int* column, int* line, std::string* file) const
+{
+    const LineRow* row = find(address);
+
+    if (column != NULL)
+        *column = row == NULL ? 0 : row->column;
+
+    if (line != NULL)
+        *line = row == NULL ? 0 : row->line;
+
+    if (file != NULL)
+        *file = row == NULL ? "" : fileName(row->file);
+}
+
+std::vector<const LineRow*> LineTable::rows(std::uint64_t start, std::uint64_t end) const
+{
+    std::vector<const LineRow*> covering;
+
+    const LineRow* first = find(start);
+
+    if (first != NULL)
+        covering.push_back(first);
+
+    auto it = std::lower_bound(table.begin(), table.end(), start + 1, [](const LineRow& row, std::uint64_t address)
+    {
+        return row.address < address;
+    });
+
+    for (; it != table.end() && it->address < end; it++)
+    {
+        if (it->address != it->end)
+            covering.push_back(&*it);
+    }
+
+    return covering;
+}
+
+const std::string& LineTable::fileName(int file) const
+{
+    static const std::string unknown;
+
+    if (file < 0 || file >= (int)files.size())
+        return unknown;
+
+    return files[file];
+}
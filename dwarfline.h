@@ -0,0 +1,48 @@
+#ifndef DWARFLINE_H
+#define DWARFLINE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class ElfFile;
+
+/* One row of a DWARF line program, it covers the addresses up to the next row of its sequence */
+struct LineRow
+{
+    std::uint64_t address;
+    std::uint64_t end;
+
+    int file;
+    int line;
+    int column;
+};
+
+/* Address to source location lookup over all line programs of an image (.debug_line, DWARF 2 to 5) */
+class LineTable
+{
+public:
+    LineTable(const ElfFile& elf);
+
+    /* Same results as PIN_GetSourceLocation, line 0 and an empty file if the address has no row */
+    void lookup(std::uint64_t address, int* column, int* line, std::string* file) const;
+
+    /* Rows covering a part of [start, end), sorted by address */
+    std::vector<const LineRow*> rows(std::uint64_t start, std::uint64_t end) const;
+
+    const std::string& fileName(int file) const;
+
+private:
+    void parseCompilationDirectories(const std::string& info, const std::string& abbrev, const std::string& str, const std::string& lineStr);
+    void parseProgram(const std::string& section, std::size_t offset, const std::string& str, const std::string& lineStr, std::size_t* next);
+
+    const LineRow* find(std::uint64_t address) const;
+
+    std::vector<LineRow> table;
+    std::vector<std::string> files;
+
+    /* DW_AT_comp_dir of each compilation unit by DW_AT_stmt_list, relative paths before DWARF 5 are relative to it */
+    std::vector<std::pair<std::uint64_t, std::string> > compilationDirectories;
+};
+
+#endif // DWARFLINE_H
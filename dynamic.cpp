@@ -1,5 +1,6 @@
 #include <stdio.h>
 
+#include <algorithm>
 #include <iostream>
 #include <utility>
 
@@ -20,8 +21,114 @@ KNOB<string> KnobInputFile(KNOB_MODE_WRITEONCE, "pintool",
 KNOB<string> KnobFilterFile(KNOB_MODE_WRITEONCE, "pintool",
                             "filter", "filter.yaml", "specify filter file name");
 
+KNOB<string> KnobDatabaseMode(KNOB_MODE_WRITEONCE, "pintool",
+                              "db-mode", "file", "database mode: file or memory (written to the db file at exit)");
+
+KNOB<UINT64> KnobDatabaseMemoryLimit(KNOB_MODE_WRITEONCE, "pintool",
+                                     "db-memory-limit", "4096", "MB an in-memory database may use before it is spilled to the db file, 0 for no limit");
+
+KNOB<INT32> KnobDatabaseBackupStep(KNOB_MODE_WRITEONCE, "pintool",
+                                   "db-backup-step", "-1", "pages copied per step when writing an in-memory database, -1 for a single step");
+
+KNOB<BOOL> KnobCallingContextTree(KNOB_MODE_WRITEONCE, "pintool",
+                                  "cct", "0", "aggregate calls into a calling context tree instead of one Call row per invocation");
+
+KNOB<BOOL> KnobAggregateAccesses(KNOB_MODE_WRITEONCE, "pintool",
+                                 "aggregate-accesses", "0", "aggregate accesses per instruction, reference and segment instead of one Access row per access");
+
+KNOB<BOOL> KnobSummarizeConflicts(KNOB_MODE_WRITEONCE, "pintool",
+                                  "summarize-conflicts", "0", "write one summary per pair of tag instances, reference and access types instead of one row per conflict");
+
+KNOB<BOOL> KnobDetectLoops(KNOB_MODE_WRITEONCE, "pintool",
+                           "loops", "0", "detect loops by their back edges and give each loop execution its own segment");
+
+KNOB<BOOL> KnobLoopIterationSegments(KNOB_MODE_WRITEONCE, "pintool",
+                                     "loop-iterations", "0", "give every loop iteration its own segment instead of aggregating iterations per execution");
+
+KNOB<BOOL> KnobDropRedZoneWrites(KNOB_MODE_WRITEONCE, "pintool",
+                                 "drop-red-zone-writes", "0", "do not instrument writes below the stack pointer, they are never part of a conflict");
+
+KNOB<BOOL> KnobBatchAccesses(KNOB_MODE_WRITEONCE, "pintool",
+                             "batch-accesses", "0", "record the memory instructions of a basic block in one entry with one timestamp, their addresses are computed from the registers at its start");
+
+KNOB<UINT64> KnobSlowdownBudget(KNOB_MODE_WRITEONCE, "pintool",
+                                "slowdown-budget", "0", "sample accesses of threads whose analysis makes them more than this many times slower, 0 to trace every access");
+
+KNOB<UINT64> KnobSamplingPeriod(KNOB_MODE_WRITEONCE, "pintool",
+                                "sampling-period", "0", "record accesses of sampling-burst memory instructions out of every sampling-period a thread executes, 0 to record every access");
+
+KNOB<UINT64> KnobSamplingBurst(KNOB_MODE_WRITEONCE, "pintool",
+                               "sampling-burst", "1000", "memory instructions recorded in a row per sampling period");
+
+KNOB<string> KnobTelemetryFile(KNOB_MODE_WRITEONCE, "pintool",
+                               "telemetry", "", "publish live stats of every thread in this file, e.g. /dev/shm/pintool, read it with pintool_monitor");
+
+DatabaseOptions databaseOptions()
+{
+    DatabaseOptions options;
+
+    options.mode = parseDatabaseMode(KnobDatabaseMode.Value());
+    options.memoryLimit = KnobDatabaseMemoryLimit.Value() * 1024 * 1024;
+    options.backupPagesPerStep = KnobDatabaseBackupStep.Value();
+
+    return options;
+}
+
 BUFFER_ID bufId;
 
+/* Burst sampling, each thread counts down the memory instructions left in its period in a tool register. The first
+ * burst of them are recorded, the rest only cost the inlined countdown. */
+REG samplingRegister;
+ADDRINT samplingPeriod;
+ADDRINT samplingThreshold;
+
+struct SamplingCountdown
+{
+    ADDRINT left;
+
+    /* Whether the last memory instruction or run was recorded, for its continuation entries */
+    ADDRINT sampled;
+} __attribute__((aligned(64)));
+
+SamplingCountdown samplingCountdowns[PIN_MAX_THREADS];
+
+// Without branches so Pin inlines it
+ADDRINT PIN_FAST_ANALYSIS_CALL SampleAccess(SamplingCountdown* countdown)
+{
+    ADDRINT left = countdown->left;
+
+    left += samplingPeriod & -(ADDRINT)(left == 0);
+    countdown->left = --left;
+    countdown->sampled = left >= samplingThreshold;
+
+    return countdown->sampled;
+}
+
+/* A batched run counts down as its count memory instructions and is recorded if the first of them falls into the
+ * burst. Instructions past the end of the period are charged to the next one. */
+ADDRINT PIN_FAST_ANALYSIS_CALL SampleAccesses(SamplingCountdown* countdown, ADDRINT count)
+{
+    ADDRINT left = countdown->left;
+
+    left += samplingPeriod & -(ADDRINT)(left == 0);
+    countdown->sampled = left > samplingThreshold;
+
+    left -= count;
+    left += samplingPeriod & -(ADDRINT)(left >= samplingPeriod);
+
+    // Only a run longer than a whole period is still past it
+    left &= -(ADDRINT)(left < samplingPeriod);
+    countdown->left = left;
+
+    return countdown->sampled;
+}
+
+/* Whether the last memory instruction or run was sampled */
+ADDRINT PIN_FAST_ANALYSIS_CALL AccessSampled(SamplingCountdown* countdown)
+{
+    return countdown->sampled;
+}
+
 
 void ReplacedFree(ADDRINT d, const CONTEXT* ctx, AFUNPTR mallocPtr, UINT64 tsc, THREADID tid, ADDRINT address)
 {
@@ -145,6 +252,84 @@ void processAlloc(Manager* manager, RTN rtn, AllocType type) {
     //RTN_Close(rtn);
 }
 
+/* Red zone operands always are below the stack pointer of the instruction, frame operands are checked against the
+ * frame when analyzed */
+StackOperand classifyStackOperand(INS ins, UINT32 memOp, bool framePointer)
+{
+    UINT32 operand = INS_MemoryOperandIndexToOperandIndex(ins, memOp);
+
+    REG base = INS_OperandMemoryBaseReg(ins, operand);
+    ADDRDELTA displacement = INS_OperandMemoryDisplacement(ins, operand);
+
+    if (REG_valid(INS_OperandMemoryIndexReg(ins, operand)))
+        return StackOperand::None;
+
+    if (base == REG_RSP && displacement < 0 && displacement >= -128)
+        return StackOperand::RedZone;
+
+    if (base == REG_RSP && displacement >= 0)
+        return StackOperand::Frame;
+
+    if (base == REG_GBP && framePointer && displacement < 0)
+        return StackOperand::Frame;
+
+    return StackOperand::None;
+}
+
+/* Addresses of a loop found in a routine, from its header to the end of its last back edge */
+struct LoopRange
+{
+    UINT32 loopId;
+    ADDRINT header;
+    ADDRINT end;
+};
+
+/* The exit at an address ends the outermost loop left there, which ends the loops nested in it as well */
+void addLoopExit(std::map<ADDRINT, const LoopRange*>& exits, ADDRINT address, const LoopRange* loop)
+{
+    auto it = exits.find(address);
+
+    if (it == exits.end())
+        exits.insert(std::make_pair(address, loop));
+    else if (loop->header <= it->second->header && loop->end >= it->second->end)
+        it->second = loop;
+}
+
+/* Loops are left by falling through their last back edge and by breaks, gotos and other direct branches out of
+ * their range, each of these landing addresses gets a loop exit */
+void addLoopExits(Manager* manager, RTN rtn, const std::vector<LoopRange>& loops)
+{
+    std::map<ADDRINT, const LoopRange*> exits;
+
+    for (auto& loop : loops)
+    {
+        addLoopExit(exits, loop.end, &loop);
+    }
+
+    for (INS ins = RTN_InsHead(rtn); INS_Valid(ins); ins = INS_Next(ins))
+    {
+        if (!INS_IsBranch(ins) || !INS_IsDirectBranchOrCall(ins))
+            continue;
+
+        ADDRINT address = INS_Address(ins);
+        ADDRINT target = INS_DirectBranchOrCallTargetAddress(ins);
+
+        for (auto& loop : loops)
+        {
+            if (address >= loop.header && address < loop.end && (target < loop.header || target >= loop.end))
+                addLoopExit(exits, target, &loop);
+        }
+    }
+
+    for (auto& it : exits)
+    {
+        manager->loopExitsToInstrument.insert(std::make_pair(it.first, (LoopBufferEntry)
+        {
+            it.second->loopId, LoopEventType::Exit
+        }));
+    }
+}
+
 VOID ImageLoad(IMG img, VOID *v)
 {
     Manager* manager = (Manager*)v;
@@ -186,6 +371,15 @@ VOID ImageLoad(IMG img, VOID *v)
     {
         int imageId = manager->writer.getImageIdByName(image);
 
+        const AddressRanges* ranges = manager->filter.findImageRanges(image);
+
+        if (ranges != NULL)
+        {
+            manager->imageFilteredAddresses[IMG_Id(img)].add(*ranges, IMG_LoadOffset(img));
+            manager->filteredAddresses.add(*ranges, IMG_LoadOffset(img));
+            manager->filteredAddresses.compile();
+        }
+
         for (SEC sec = IMG_SecHead(img); SEC_Valid(sec); sec = SEC_Next(sec))
         {
             for (RTN rtn = SEC_RtnHead(sec); RTN_Valid(rtn); rtn = RTN_Next(rtn))
@@ -259,10 +453,19 @@ VOID ImageLoad(IMG img, VOID *v)
                     }
                 }
 
+                std::vector<LoopRange> loops;
+
+                // rbp is a frame pointer once the prologue moved rsp into it
+                bool framePointer = false;
+
                 for (INS ins = RTN_InsHead(rtn); INS_Valid(ins); ins = INS_Next(ins))
                 {
                     ADDRINT address = INS_Address(ins);
 
+                    if (INS_IsMov(ins) && INS_OperandIsReg(ins, 0) && INS_OperandReg(ins, 0) == REG_GBP &&
+                        INS_OperandIsReg(ins, 1) && INS_OperandReg(ins, 1) == REG_RSP)
+                        framePointer = true;
+
                     if(INS_IsRet(ins))
                     {
                         manager->retAddressesToInstrument.insert(std::make_pair(address, (RetBufferEntry)
@@ -271,6 +474,53 @@ VOID ImageLoad(IMG img, VOID *v)
                         }));
                     }
 
+                    if (manager->detectLoops && INS_IsBranch(ins) && INS_IsDirectBranchOrCall(ins))
+                    {
+                        ADDRINT target = INS_DirectBranchOrCallTargetAddress(ins);
+
+                        // A branch back into the routine closes a loop, its target is the loop header
+                        if (target <= address && target >= RTN_Address(rtn))
+                        {
+                            UINT32 loopId;
+
+                            auto it = manager->loopHeadersToInstrument.find(target);
+
+                            if (it == manager->loopHeadersToInstrument.end())
+                            {
+                                LoopHeader loop;
+
+                                loop.function = functionId;
+                                PIN_GetSourceLocation(target, &loop.column, &loop.line, NULL);
+                                manager->writer.insertLoopHeader(loop);
+
+                                loopId = (UINT32)loop.id;
+
+                                manager->loopHeadersToInstrument.insert(std::make_pair(target, (LoopBufferEntry)
+                                {
+                                    loopId, LoopEventType::Header
+                                }));
+                            }
+                            else
+                            {
+                                loopId = it->second.loopId;
+                            }
+
+                            bool known = false;
+
+                            for (auto& it : loops)
+                            {
+                                if (it.loopId == loopId)
+                                {
+                                    it.end = std::max(it.end, address + INS_Size(ins));
+                                    known = true;
+                                }
+                            }
+
+                            if (!known)
+                                loops.push_back({loopId, target, address + INS_Size(ins)});
+                        }
+                    }
+
                     if (INS_IsStandardMemop(ins) || INS_HasMemoryVector(ins))
                     {
                         UINT32 memoryOperandCount = INS_MemoryOperandCount(ins);
@@ -280,7 +530,8 @@ VOID ImageLoad(IMG img, VOID *v)
 
                         AccessInstructionDetails entry;
                         entry.accesses.reserve(memoryOperandCount);
-                        entry.location = manager->getLocation(address, functionId);
+
+                        bool redZoneWritesOnly = true;
 
                         for (UINT32 memOp = 0; memOp < memoryOperandCount; memOp++)
                         {
@@ -290,12 +541,24 @@ VOID ImageLoad(IMG img, VOID *v)
                             opDetail.isRead = INS_MemoryOperandIsRead(ins, memOp);
                             opDetail.isWrite = INS_MemoryOperandIsWritten(ins, memOp);
 
+                            // Gathers and scatters have no single base register
+                            opDetail.stack = INS_IsStandardMemop(ins) ? classifyStackOperand(ins, memOp, framePointer) : StackOperand::None;
+
+                            if (opDetail.stack != StackOperand::RedZone || opDetail.isRead)
+                                redZoneWritesOnly = false;
+
                             entry.accesses.push_back(opDetail);
                         }
 
-                        manager->accessDetails.push_back(entry);
+                        // A dropped instruction can still be a call, it is instrumented below
+                        if (!manager->dropRedZoneWrites || !redZoneWritesOnly)
+                        {
+                            entry.location = manager->getLocation(address, functionId);
 
-                        manager->accessToInstrument.insert(std::make_pair(address, manager->accessDetails.size() - 1));
+                            manager->accessDetails.push_back(entry);
+
+                            manager->accessToInstrument.insert(std::make_pair(address, manager->accessDetails.size() - 1));
+                        }
                     }
 
                     if (INS_IsCall(ins))
@@ -306,6 +569,9 @@ VOID ImageLoad(IMG img, VOID *v)
                     }
                 }
 
+                if (!loops.empty())
+                    addLoopExits(manager, rtn, loops);
+
                 RTN_Close(rtn);
             }
         }
@@ -314,6 +580,231 @@ VOID ImageLoad(IMG img, VOID *v)
     PIN_UnlockClient();
 }
 
+/* Another image can be mapped at the addresses of an unloaded one, so its ranges must not filter anymore */
+VOID ImageUnload(IMG img, VOID *v)
+{
+    Manager* manager = (Manager*)v;
+
+    manager->lock();
+
+    if (manager->imageFilteredAddresses.erase(IMG_Id(img)) > 0)
+    {
+        manager->filteredAddresses = AddressRanges();
+
+        for (auto& it : manager->imageFilteredAddresses)
+            manager->filteredAddresses.add(it.second, 0);
+
+        manager->filteredAddresses.compile();
+    }
+
+    manager->unlock();
+}
+
+/* Batching memory instructions of a basic block. Pin can only compute an effective address at its own instruction,
+ * so the block entry captures the registers the addresses depend on and the analysis adds the displacements. */
+
+bool isBatchable(INS ins)
+{
+    return INS_IsStandardMemop(ins) && !INS_IsCall(ins) && !INS_IsRet(ins) && !INS_IsStackRead(ins) && !INS_IsStackWrite(ins) &&
+           !INS_HasRealRep(ins) && INS_EffectiveAddressWidth(ins) == 64;
+}
+
+/* Base and index of the operand, false if its address does not only depend on general purpose registers */
+bool decodeBlockOperand(INS ins, UINT32 memOp, REG* base, REG* index, BlockOperand* operand)
+{
+    UINT32 op = INS_MemoryOperandIndexToOperandIndex(ins, memOp);
+
+    if (!INS_OperandIsMemory(ins, op) || REG_valid(INS_OperandMemorySegmentReg(ins, op)))
+        return false;
+
+    *base = INS_OperandMemoryBaseReg(ins, op);
+    *index = INS_OperandMemoryIndexReg(ins, op);
+
+    operand->scale = INS_OperandMemoryScale(ins, op);
+    operand->displacement = INS_OperandMemoryDisplacement(ins, op);
+
+    // rip relative addresses are known already
+    if (*base == REG_INST_PTR)
+    {
+        *base = REG_INVALID();
+        operand->displacement += INS_Address(ins) + INS_Size(ins);
+    }
+
+    return (!REG_valid(*base) || REG_is_gr64(*base)) && (!REG_valid(*index) || REG_is_gr64(*index));
+}
+
+bool hasOtherEntries(Manager* manager, ADDRINT address)
+{
+    return manager->tagAddressesToInstrument.count(address) > 0 || manager->callInstructionAddressesToInstrument.count(address) > 0 ||
+           manager->callAddressesToInstrument.count(address) > 0 || manager->loopExitsToInstrument.count(address) > 0 ||
+           manager->loopHeadersToInstrument.count(address) > 0 || manager->retAddressesToInstrument.count(address) > 0;
+}
+
+INT32 registerSlot(std::vector<REG>& registers, REG reg)
+{
+    if (!REG_valid(reg))
+        return -1;
+
+    auto it = std::find(registers.begin(), registers.end(), reg);
+
+    if (it != registers.end())
+        return it - registers.begin();
+
+    registers.push_back(reg);
+
+    return registers.size() - 1;
+}
+
+/* Adds the instruction to the block unless it uses a register written since the block started or the block would
+ * need more registers than its entries have room for */
+bool addToBlock(INS ins, AccessInstructionDetails* details, const std::set<REG>& written, BlockAccessDetails& block)
+{
+    if (written.count(REG_RSP) > 0)
+        return false;
+
+    BlockInstruction instruction;
+    std::vector<REG> registers = block.registers;
+
+    instruction.details = details;
+
+    for (UINT32 memOp = 0; memOp < details->accesses.size(); memOp++)
+    {
+        REG base;
+        REG index;
+        BlockOperand operand;
+
+        if (!decodeBlockOperand(ins, memOp, &base, &index, &operand))
+            return false;
+
+        if (written.count(base) > 0 || written.count(index) > 0)
+            return false;
+
+        operand.base = registerSlot(registers, base);
+        operand.index = registerSlot(registers, index);
+
+        instruction.operands.push_back(operand);
+    }
+
+    if (registers.size() > maxMemRefAddresses)
+        return false;
+
+    block.instructions.push_back(instruction);
+    block.registers = registers;
+
+    return true;
+}
+
+void closeBlock(Manager* manager, ADDRINT head, BlockAccessDetails& block, std::vector<ADDRINT>& members,
+                std::map<ADDRINT, BlockAccessDetails*>& blocks, std::set<ADDRINT>& batched)
+{
+    // A single instruction is cheaper as a MemRef entry
+    if (block.instructions.size() > 1)
+    {
+        manager->blockAccessDetails.push_back(block);
+        blocks[head] = &manager->blockAccessDetails.back();
+        batched.insert(members.begin(), members.end());
+    }
+
+    block.instructions.clear();
+    block.registers.clear();
+    members.clear();
+}
+
+/* Splits the memory instructions of the basic block into runs recorded at their first instruction. A run ends before
+ * any instruction with other entries or a memory instruction that cannot join it, so the order of the entries stays
+ * the same. */
+void planBlockAccesses(Manager* manager, BBL bbl, bool rangesOverlap, std::map<ADDRINT, BlockAccessDetails*>& blocks, std::set<ADDRINT>& batched)
+{
+    BlockAccessDetails block;
+    std::vector<ADDRINT> members;
+    std::set<REG> written;
+    ADDRINT head = 0;
+
+    for (INS ins = BBL_InsHead(bbl); INS_Valid(ins); ins = INS_Next(ins))
+    {
+        ADDRINT address = INS_Address(ins);
+
+        if (hasOtherEntries(manager, address))
+            closeBlock(manager, head, block, members, blocks, batched);
+
+        auto it = manager->accessToInstrument.find(address);
+
+        // Filtered accesses get no entry, for the run they are like any other instruction
+        if (it != manager->accessToInstrument.end() && !(rangesOverlap && manager->filteredAddresses.contains(address)))
+        {
+            AccessInstructionDetails* details = &manager->accessDetails[it->second];
+
+            bool added = isBatchable(ins) && !block.instructions.empty() && addToBlock(ins, details, written, block);
+
+            if (!added)
+            {
+                closeBlock(manager, head, block, members, blocks, batched);
+                written.clear();
+
+                if (isBatchable(ins) && addToBlock(ins, details, written, block))
+                    head = address;
+            }
+
+            if (!block.instructions.empty())
+                members.push_back(address);
+        }
+
+        for (UINT32 i = 0; i < INS_MaxNumWRegs(ins); i++)
+            written.insert(REG_FullRegName(INS_RegW(ins, i)));
+    }
+
+    closeBlock(manager, head, block, members, blocks, batched);
+}
+
+void InsertBlockAccesses(INS ins, const BlockAccessDetails* block)
+{
+    // Unused slots take rsp, it is read anyway
+    REG registers[maxMemRefAddresses];
+
+    for (UINT32 i = 0; i < maxMemRefAddresses; i++)
+        registers[i] = i < block->registers.size() ? block->registers[i] : REG_RSP;
+
+    void (*fillBuffer)(INS, IPOINT, BUFFER_ID, ...) = INS_InsertFillBuffer;
+
+    if (samplingPeriod > 0)
+    {
+        INS_InsertIfCall(ins, IPOINT_BEFORE, (AFUNPTR)SampleAccesses, IARG_FAST_ANALYSIS_CALL,
+                         IARG_REG_VALUE, samplingRegister,
+                         IARG_ADDRINT, (ADDRINT)block->instructions.size(),
+                         IARG_END);
+
+        fillBuffer = INS_InsertFillBufferThen;
+    }
+
+    fillBuffer(ins, IPOINT_BEFORE, bufId,
+               IARG_UINT32, static_cast<UINT32>(BuferEntryType::BlockAccesses), offsetof(struct BufferEntry, type),
+               IARG_REG_VALUE, REG_RSP, offsetof(struct BufferEntry, data) + offsetof(struct BlockAccessesBufferEntry, rsp),
+               IARG_ADDRINT, (ADDRINT)block, offsetof(struct BufferEntry, data) + offsetof(struct BlockAccessesBufferEntry, block),
+               IARG_TSC, offsetof(struct BufferEntry, data) + offsetof(struct BlockAccessesBufferEntry, tsc),
+               IARG_REG_VALUE, registers[0], offsetof(struct BufferEntry, data) + offsetof(struct BlockAccessesBufferEntry, registers) + 0 * sizeof(ADDRINT),
+               IARG_REG_VALUE, registers[1], offsetof(struct BufferEntry, data) + offsetof(struct BlockAccessesBufferEntry, registers) + 1 * sizeof(ADDRINT),
+               IARG_END);
+
+    if (block->registers.size() <= memRefAddresses)
+        return;
+
+    if (samplingPeriod > 0)
+    {
+        INS_InsertIfCall(ins, IPOINT_BEFORE, (AFUNPTR)AccessSampled, IARG_FAST_ANALYSIS_CALL,
+                         IARG_REG_VALUE, samplingRegister,
+                         IARG_END);
+    }
+
+    fillBuffer(ins, IPOINT_BEFORE, bufId,
+               IARG_UINT32, static_cast<UINT32>(BuferEntryType::MemRefAddresses), offsetof(struct BufferEntry, type),
+               IARG_REG_VALUE, registers[2], offsetof(struct BufferEntry, data) + offsetof(struct AccessAddressesBufferEntry, addresses) + 0 * sizeof(ADDRINT),
+               IARG_REG_VALUE, registers[3], offsetof(struct BufferEntry, data) + offsetof(struct AccessAddressesBufferEntry, addresses) + 1 * sizeof(ADDRINT),
+               IARG_REG_VALUE, registers[4], offsetof(struct BufferEntry, data) + offsetof(struct AccessAddressesBufferEntry, addresses) + 2 * sizeof(ADDRINT),
+               IARG_REG_VALUE, registers[5], offsetof(struct BufferEntry, data) + offsetof(struct AccessAddressesBufferEntry, addresses) + 3 * sizeof(ADDRINT),
+               IARG_REG_VALUE, registers[6], offsetof(struct BufferEntry, data) + offsetof(struct AccessAddressesBufferEntry, addresses) + 4 * sizeof(ADDRINT),
+               IARG_END);
+}
+
 VOID Trace(TRACE trace, VOID *v)
 {
     Manager* manager = (Manager*)v;
@@ -323,9 +814,21 @@ VOID Trace(TRACE trace, VOID *v)
 
     for (BBL bbl = TRACE_BblHead(trace); BBL_Valid(bbl); bbl = BBL_Next(bbl))
     {
+        // Calls, returns, tags and loops keep their events so call stacks and segments stay balanced
+        // A block can run into a range, so the instructions are checked one by one when it overlaps any
+        bool rangesOverlap = !manager->filteredAddresses.empty() &&
+                             manager->filteredAddresses.overlaps(BBL_Address(bbl), BBL_Address(bbl) + BBL_Size(bbl));
+
+        std::map<ADDRINT, BlockAccessDetails*> blocks;
+        std::set<ADDRINT> batched;
+
+        if (manager->batchAccesses)
+            planBlockAccesses(manager, bbl, rangesOverlap, blocks, batched);
+
         for(INS ins = BBL_InsHead(bbl); INS_Valid(ins); ins=INS_Next(ins))
         {
             ADDRINT address = INS_Address(ins);
+            bool accessesFiltered = rangesOverlap && manager->filteredAddresses.contains(address);
 
             {
                 auto it = manager->tagAddressesToInstrument.find(address);
@@ -370,6 +873,34 @@ VOID Trace(TRACE trace, VOID *v)
                 }
             }
 
+            {
+                auto it = manager->loopExitsToInstrument.find(address);
+
+                if (it != manager->loopExitsToInstrument.end())
+                {
+                    INS_InsertFillBuffer(ins, IPOINT_BEFORE, bufId,
+                                         IARG_UINT32, static_cast<UINT32>(BuferEntryType::Loop), offsetof(struct BufferEntry, type),
+                                         IARG_UINT32, static_cast<UINT32>(it->second.loopId), offsetof(struct BufferEntry, data) + offsetof(struct LoopBufferEntry, loopId),
+                                         IARG_UINT32, static_cast<UINT32>(LoopEventType::Exit), offsetof(struct BufferEntry, data) + offsetof(struct LoopBufferEntry, type),
+                                         IARG_TSC, offsetof(struct BufferEntry, data) + offsetof(struct LoopBufferEntry, tsc),
+                                         IARG_END);
+                }
+            }
+
+            {
+                auto it = manager->loopHeadersToInstrument.find(address);
+
+                if (it != manager->loopHeadersToInstrument.end())
+                {
+                    INS_InsertFillBuffer(ins, IPOINT_BEFORE, bufId,
+                                         IARG_UINT32, static_cast<UINT32>(BuferEntryType::Loop), offsetof(struct BufferEntry, type),
+                                         IARG_UINT32, static_cast<UINT32>(it->second.loopId), offsetof(struct BufferEntry, data) + offsetof(struct LoopBufferEntry, loopId),
+                                         IARG_UINT32, static_cast<UINT32>(LoopEventType::Header), offsetof(struct BufferEntry, data) + offsetof(struct LoopBufferEntry, type),
+                                         IARG_TSC, offsetof(struct BufferEntry, data) + offsetof(struct LoopBufferEntry, tsc),
+                                         IARG_END);
+                }
+            }
+
             {
                 auto it = manager->retAddressesToInstrument.find(address);
 
@@ -384,6 +915,14 @@ VOID Trace(TRACE trace, VOID *v)
                 }
             }
 
+            if (batched.count(address) > 0)
+            {
+                auto it = blocks.find(address);
+
+                if (it != blocks.end())
+                    InsertBlockAccesses(ins, it->second);
+            }
+            else if (!accessesFiltered)
             {
                 auto it = manager->accessToInstrument.find(address);
 
@@ -392,94 +931,102 @@ VOID Trace(TRACE trace, VOID *v)
                     AccessInstructionDetails& detail = manager->accessDetails[it->second];
                     AccessInstructionDetails* detailPtr = &detail;
 
+                    void (*fillBuffer)(INS, IPOINT, BUFFER_ID, ...) = INS_InsertFillBuffer;
+
+                    if (samplingPeriod > 0)
+                    {
+                        INS_InsertIfCall(ins, IPOINT_BEFORE, (AFUNPTR)SampleAccess, IARG_FAST_ANALYSIS_CALL,
+                                         IARG_REG_VALUE, samplingRegister,
+                                         IARG_END);
+
+                        fillBuffer = INS_InsertFillBufferThen;
+                    }
+
                     switch(detail.accesses.size())
                     {
                     case 1:
-                        INS_InsertFillBuffer(ins, IPOINT_BEFORE, bufId,
-                                             IARG_UINT32, static_cast<UINT32>(BuferEntryType::MemRef), offsetof(struct BufferEntry, type),
-                                             IARG_REG_VALUE, REG_RSP, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, rsp),
-                                             IARG_ADDRINT, (ADDRINT)detailPtr, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, accessDetails),
-                                             IARG_TSC, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, tsc),
-                                             IARG_MEMORYOP_EA, 0, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, addresses) + 0 * sizeof(ADDRINT),
-                                             IARG_END);
+                        fillBuffer(ins, IPOINT_BEFORE, bufId,
+                                   IARG_UINT32, static_cast<UINT32>(BuferEntryType::MemRef), offsetof(struct BufferEntry, type),
+                                   IARG_REG_VALUE, REG_RSP, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, rsp),
+                                   IARG_ADDRINT, (ADDRINT)detailPtr, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, accessDetails),
+                                   IARG_TSC, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, tsc),
+                                   IARG_MEMORYOP_EA, 0, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, addresses) + 0 * sizeof(ADDRINT),
+                                   IARG_END);
                         break;
                     case 2:
-                        INS_InsertFillBuffer(ins, IPOINT_BEFORE, bufId,
-                                             IARG_UINT32, static_cast<UINT32>(BuferEntryType::MemRef), offsetof(struct BufferEntry, type),
-                                             IARG_REG_VALUE, REG_RSP, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, rsp),
-                                             IARG_ADDRINT, (ADDRINT)detailPtr, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, accessDetails),
-                                             IARG_TSC, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, tsc),
-                                             IARG_MEMORYOP_EA, 0, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, addresses) + 0 * sizeof(ADDRINT),
-                                             IARG_MEMORYOP_EA, 1, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, addresses) + 1 * sizeof(ADDRINT),
-                                             IARG_END);
-                        break;
-                    case 3:
-                        INS_InsertFillBuffer(ins, IPOINT_BEFORE, bufId,
-                                             IARG_UINT32, static_cast<UINT32>(BuferEntryType::MemRef), offsetof(struct BufferEntry, type),
-                                             IARG_REG_VALUE, REG_RSP, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, rsp),
-                                             IARG_ADDRINT, (ADDRINT)detailPtr, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, accessDetails),
-                                             IARG_TSC, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, tsc),
-                                             IARG_MEMORYOP_EA, 0, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, addresses) + 0 * sizeof(ADDRINT),
-                                             IARG_MEMORYOP_EA, 1, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, addresses) + 1 * sizeof(ADDRINT),
-                                             IARG_MEMORYOP_EA, 2, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, addresses) + 2 * sizeof(ADDRINT),
-                                             IARG_END);
-                        break;
-                    case 4:
-                        INS_InsertFillBuffer(ins, IPOINT_BEFORE, bufId,
-                                             IARG_UINT32, static_cast<UINT32>(BuferEntryType::MemRef), offsetof(struct BufferEntry, type),
-                                             IARG_REG_VALUE, REG_RSP, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, rsp),
-                                             IARG_ADDRINT, (ADDRINT)detailPtr, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, accessDetails),
-                                             IARG_TSC, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, tsc),
-                                             IARG_MEMORYOP_EA, 0, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, addresses) + 0 * sizeof(ADDRINT),
-                                             IARG_MEMORYOP_EA, 1, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, addresses) + 1 * sizeof(ADDRINT),
-                                             IARG_MEMORYOP_EA, 2, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, addresses) + 2 * sizeof(ADDRINT),
-                                             IARG_MEMORYOP_EA, 3, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, addresses) + 3 * sizeof(ADDRINT),
-                                             IARG_END);
-                        break;
-                    case 5:
-                        INS_InsertFillBuffer(ins, IPOINT_BEFORE, bufId,
-                                             IARG_UINT32, static_cast<UINT32>(BuferEntryType::MemRef), offsetof(struct BufferEntry, type),
-                                             IARG_REG_VALUE, REG_RSP, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, rsp),
-                                             IARG_ADDRINT, (ADDRINT)detailPtr, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, accessDetails),
-                                             IARG_TSC, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, tsc),
-                                             IARG_MEMORYOP_EA, 0, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, addresses) + 0 * sizeof(ADDRINT),
-                                             IARG_MEMORYOP_EA, 1, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, addresses) + 1 * sizeof(ADDRINT),
-                                             IARG_MEMORYOP_EA, 2, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, addresses) + 2 * sizeof(ADDRINT),
-                                             IARG_MEMORYOP_EA, 3, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, addresses) + 3 * sizeof(ADDRINT),
-                                             IARG_MEMORYOP_EA, 4, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, addresses) + 4 * sizeof(ADDRINT),
-                                             IARG_END);
-                        break;
-                    case 6:
-                        INS_InsertFillBuffer(ins, IPOINT_BEFORE, bufId,
-                                             IARG_UINT32, static_cast<UINT32>(BuferEntryType::MemRef), offsetof(struct BufferEntry, type),
-                                             IARG_REG_VALUE, REG_RSP, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, rsp),
-                                             IARG_ADDRINT, (ADDRINT)detailPtr, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, accessDetails),
-                                             IARG_TSC, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, tsc),
-                                             IARG_MEMORYOP_EA, 0, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, addresses) + 0 * sizeof(ADDRINT),
-                                             IARG_MEMORYOP_EA, 1, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, addresses) + 1 * sizeof(ADDRINT),
-                                             IARG_MEMORYOP_EA, 2, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, addresses) + 2 * sizeof(ADDRINT),
-                                             IARG_MEMORYOP_EA, 3, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, addresses) + 3 * sizeof(ADDRINT),
-                                             IARG_MEMORYOP_EA, 4, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, addresses) + 4 * sizeof(ADDRINT),
-                                             IARG_MEMORYOP_EA, 5, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, addresses) + 5 * sizeof(ADDRINT),
-                                             IARG_END);
-                        break;
-                    case 7:
-                        INS_InsertFillBuffer(ins, IPOINT_BEFORE, bufId,
-                                             IARG_UINT32, static_cast<UINT32>(BuferEntryType::MemRef), offsetof(struct BufferEntry, type),
-                                             IARG_REG_VALUE, REG_RSP, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, rsp),
-                                             IARG_ADDRINT, (ADDRINT)detailPtr, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, accessDetails),
-                                             IARG_TSC, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, tsc),
-                                             IARG_MEMORYOP_EA, 0, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, addresses) + 0 * sizeof(ADDRINT),
-                                             IARG_MEMORYOP_EA, 1, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, addresses) + 1 * sizeof(ADDRINT),
-                                             IARG_MEMORYOP_EA, 2, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, addresses) + 2 * sizeof(ADDRINT),
-                                             IARG_MEMORYOP_EA, 3, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, addresses) + 3 * sizeof(ADDRINT),
-                                             IARG_MEMORYOP_EA, 4, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, addresses) + 4 * sizeof(ADDRINT),
-                                             IARG_MEMORYOP_EA, 5, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, addresses) + 5 * sizeof(ADDRINT),
-                                             IARG_MEMORYOP_EA, 6, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, addresses) + 6 * sizeof(ADDRINT),
-                                             IARG_END);
+                        fillBuffer(ins, IPOINT_BEFORE, bufId,
+                                   IARG_UINT32, static_cast<UINT32>(BuferEntryType::MemRef), offsetof(struct BufferEntry, type),
+                                   IARG_REG_VALUE, REG_RSP, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, rsp),
+                                   IARG_ADDRINT, (ADDRINT)detailPtr, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, accessDetails),
+                                   IARG_TSC, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, tsc),
+                                   IARG_MEMORYOP_EA, 0, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, addresses) + 0 * sizeof(ADDRINT),
+                                   IARG_MEMORYOP_EA, 1, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, addresses) + 1 * sizeof(ADDRINT),
+                                   IARG_END);
                         break;
                     default:
-                        UnimplementedException("Too many memory operations per instruction");
+                        if (detail.accesses.size() > maxMemRefAddresses)
+                            UnimplementedException("Too many memory operations per instruction");
+
+                        fillBuffer(ins, IPOINT_BEFORE, bufId,
+                                   IARG_UINT32, static_cast<UINT32>(BuferEntryType::MemRef), offsetof(struct BufferEntry, type),
+                                   IARG_REG_VALUE, REG_RSP, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, rsp),
+                                   IARG_ADDRINT, (ADDRINT)detailPtr, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, accessDetails),
+                                   IARG_TSC, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, tsc),
+                                   IARG_MEMORYOP_EA, 0, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, addresses) + 0 * sizeof(ADDRINT),
+                                   IARG_MEMORYOP_EA, 1, offsetof(struct BufferEntry, data) + offsetof(struct AccessInstructionBufferEntry, addresses) + 1 * sizeof(ADDRINT),
+                                   IARG_END);
+
+                        // The second entry is only written if the first one was, without counting down again
+                        if (samplingPeriod > 0)
+                        {
+                            INS_InsertIfCall(ins, IPOINT_BEFORE, (AFUNPTR)AccessSampled, IARG_FAST_ANALYSIS_CALL,
+                                             IARG_REG_VALUE, samplingRegister,
+                                             IARG_END);
+                        }
+
+                        switch(detail.accesses.size() - memRefAddresses)
+                        {
+                        case 1:
+                            fillBuffer(ins, IPOINT_BEFORE, bufId,
+                                       IARG_UINT32, static_cast<UINT32>(BuferEntryType::MemRefAddresses), offsetof(struct BufferEntry, type),
+                                       IARG_MEMORYOP_EA, 2, offsetof(struct BufferEntry, data) + offsetof(struct AccessAddressesBufferEntry, addresses) + 0 * sizeof(ADDRINT),
+                                       IARG_END);
+                            break;
+                        case 2:
+                            fillBuffer(ins, IPOINT_BEFORE, bufId,
+                                       IARG_UINT32, static_cast<UINT32>(BuferEntryType::MemRefAddresses), offsetof(struct BufferEntry, type),
+                                       IARG_MEMORYOP_EA, 2, offsetof(struct BufferEntry, data) + offsetof(struct AccessAddressesBufferEntry, addresses) + 0 * sizeof(ADDRINT),
+                                       IARG_MEMORYOP_EA, 3, offsetof(struct BufferEntry, data) + offsetof(struct AccessAddressesBufferEntry, addresses) + 1 * sizeof(ADDRINT),
+                                       IARG_END);
+                            break;
+                        case 3:
+                            fillBuffer(ins, IPOINT_BEFORE, bufId,
+                                       IARG_UINT32, static_cast<UINT32>(BuferEntryType::MemRefAddresses), offsetof(struct BufferEntry, type),
+                                       IARG_MEMORYOP_EA, 2, offsetof(struct BufferEntry, data) + offsetof(struct AccessAddressesBufferEntry, addresses) + 0 * sizeof(ADDRINT),
+                                       IARG_MEMORYOP_EA, 3, offsetof(struct BufferEntry, data) + offsetof(struct AccessAddressesBufferEntry, addresses) + 1 * sizeof(ADDRINT),
+                                       IARG_MEMORYOP_EA, 4, offsetof(struct BufferEntry, data) + offsetof(struct AccessAddressesBufferEntry, addresses) + 2 * sizeof(ADDRINT),
+                                       IARG_END);
+                            break;
+                        case 4:
+                            fillBuffer(ins, IPOINT_BEFORE, bufId,
+                                       IARG_UINT32, static_cast<UINT32>(BuferEntryType::MemRefAddresses), offsetof(struct BufferEntry, type),
+                                       IARG_MEMORYOP_EA, 2, offsetof(struct BufferEntry, data) + offsetof(struct AccessAddressesBufferEntry, addresses) + 0 * sizeof(ADDRINT),
+                                       IARG_MEMORYOP_EA, 3, offsetof(struct BufferEntry, data) + offsetof(struct AccessAddressesBufferEntry, addresses) + 1 * sizeof(ADDRINT),
+                                       IARG_MEMORYOP_EA, 4, offsetof(struct BufferEntry, data) + offsetof(struct AccessAddressesBufferEntry, addresses) + 2 * sizeof(ADDRINT),
+                                       IARG_MEMORYOP_EA, 5, offsetof(struct BufferEntry, data) + offsetof(struct AccessAddressesBufferEntry, addresses) + 3 * sizeof(ADDRINT),
+                                       IARG_END);
+                            break;
+                        case 5:
+                            fillBuffer(ins, IPOINT_BEFORE, bufId,
+                                       IARG_UINT32, static_cast<UINT32>(BuferEntryType::MemRefAddresses), offsetof(struct BufferEntry, type),
+                                       IARG_MEMORYOP_EA, 2, offsetof(struct BufferEntry, data) + offsetof(struct AccessAddressesBufferEntry, addresses) + 0 * sizeof(ADDRINT),
+                                       IARG_MEMORYOP_EA, 3, offsetof(struct BufferEntry, data) + offsetof(struct AccessAddressesBufferEntry, addresses) + 1 * sizeof(ADDRINT),
+                                       IARG_MEMORYOP_EA, 4, offsetof(struct BufferEntry, data) + offsetof(struct AccessAddressesBufferEntry, addresses) + 2 * sizeof(ADDRINT),
+                                       IARG_MEMORYOP_EA, 5, offsetof(struct BufferEntry, data) + offsetof(struct AccessAddressesBufferEntry, addresses) + 3 * sizeof(ADDRINT),
+                                       IARG_MEMORYOP_EA, 6, offsetof(struct BufferEntry, data) + offsetof(struct AccessAddressesBufferEntry, addresses) + 4 * sizeof(ADDRINT),
+                                       IARG_END);
+                            break;
+                        }
                         break;
                     }
                 }
@@ -524,12 +1071,19 @@ void bindThreadToCore()
     sched_setaffinity(0, sizeof(cpu_set_t), &my_set);
 }
 
-VOID ThreadStart(THREADID threadid, CONTEXT *, INT32, VOID *v)
+VOID ThreadStart(THREADID threadid, CONTEXT *ctxt, INT32, VOID *v)
 {
     bindThreadToCore();
 
     Manager* manager = (Manager*)v;
 
+    if (samplingPeriod > 0)
+    {
+        samplingCountdowns[threadid].left = 0;
+        samplingCountdowns[threadid].sampled = 0;
+        PIN_SetContextReg(ctxt, samplingRegister, (ADDRINT)&samplingCountdowns[threadid]);
+    }
+
     manager->setUpThreadManager(threadid);
 }
 
@@ -546,7 +1100,47 @@ int main(int argc, char * argv[])
 
     if (PIN_Init(argc, argv)) return Usage();
 
-    Manager* manager = new Manager(KnobOutputFile.Value(), KnobInputFile.Value(), KnobFilterFile.Value());
+    Manager* manager = new Manager(KnobOutputFile.Value(), KnobInputFile.Value(), KnobFilterFile.Value(), databaseOptions());
+
+    manager->aggregateCalls = KnobCallingContextTree.Value();
+    manager->aggregateAccesses = KnobAggregateAccesses.Value();
+    manager->summarizeConflicts = KnobSummarizeConflicts.Value();
+    manager->detectLoops = KnobDetectLoops.Value() || KnobLoopIterationSegments.Value();
+    manager->loopIterationSegments = KnobLoopIterationSegments.Value();
+    manager->dropRedZoneWrites = KnobDropRedZoneWrites.Value();
+    manager->batchAccesses = KnobBatchAccesses.Value();
+    manager->slowdownBudget = KnobSlowdownBudget.Value();
+
+    if (!KnobTelemetryFile.Value().empty())
+        manager->publishTelemetry(KnobTelemetryFile.Value());
+
+    AccessSampling sampling;
+
+    sampling.period = KnobSamplingPeriod.Value();
+    sampling.burst = sampling.period > 0 ? KnobSamplingBurst.Value() : 0;
+    sampling.slowdownBudget = manager->slowdownBudget;
+
+    if (sampling.period > 0 && (sampling.burst == 0 || sampling.burst > sampling.period))
+    {
+        std::cerr << "Error: sampling-burst must be between 1 and sampling-period" << endl;
+        return 1;
+    }
+
+    manager->writer.insertAccessSampling(sampling);
+
+    samplingPeriod = sampling.period;
+    samplingThreshold = sampling.period - sampling.burst;
+
+    if (samplingPeriod > 0)
+    {
+        samplingRegister = PIN_ClaimToolRegister();
+
+        if (!REG_valid(samplingRegister))
+        {
+            std::cerr << "Error: no tool register left for the sampling countdown" << endl;
+            return 1;
+        }
+    }
 
     bufId = PIN_DefineTraceBuffer(sizeof(struct BufferEntry), 100000,
                                   BufferFull, (void*)manager);
@@ -558,6 +1152,7 @@ int main(int argc, char * argv[])
     }
 
     IMG_AddInstrumentFunction(ImageLoad, (void*)manager);
+    IMG_AddUnloadFunction(ImageUnload, (void*)manager);
     PIN_AddFiniFunction(Fini, (void*)manager);
     PIN_AddThreadStartFunction(ThreadStart, (void*)manager);
     PIN_AddThreadFiniFunction(ThreadFini, (void*)manager);
@@ -0,0 +1,303 @@
+#include "elffile.h"
+
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include <zlib.h>
+
+ElfFile::ElfFile(const std::string& path) : data(NULL), length(0), modified(0)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+
+    if (fd < 0)
+    {
+        fail("cannot open " + path);
+        return;
+    }
+
+    struct stat info;
+
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(Elf64_Ehdr))
+    {
+        close(fd);
+        fail(path + " is not an ELF file");
+        return;
+    }
+
+    void* mapped = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    close(fd);
+
+    if (mapped == MAP_FAILED)
+    {
+        fail("cannot map " + path);
+        return;
+    }
+
+    data = (const unsigned char*)mapped;
+    length = info.st_size;
+    modified = (std::int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+
+    const Elf64_Ehdr* header = (const Elf64_Ehdr*)data;
+
+    if (memcmp(header->e_ident, ELFMAG, SELFMAG) != 0 || header->e_ident[EI_CLASS] != ELFCLASS64 || header->e_ident[EI_DATA] != ELFDATA2LSB)
+    {
+        fail(path + " is not a 64 bit little endian ELF file");
+        return;
+    }
+
+    if (header->e_shentsize != sizeof(Elf64_Shdr) || !inFile(header->e_shoff, (std::uint64_t)header->e_shnum * sizeof(Elf64_Shdr)))
+    {
+        fail(path + " has no valid section headers");
+        return;
+    }
+
+    const Elf64_Shdr* headers = (const Elf64_Shdr*)(data + header->e_shoff);
+
+    if (header->e_shstrndx >= header->e_shnum || !inFile(headers[header->e_shstrndx].sh_offset, headers[header->e_shstrndx].sh_size))
+    {
+        fail(path + " has no section names");
+        return;
+    }
+
+    const Elf64_Shdr& names = headers[header->e_shstrndx];
+
+    for (int i = 0; i < header->e_shnum; i++)
+    {
+        Section section;
+
+        if (headers[i].sh_name >= names.sh_size)
+            continue;
+
+        const char* name = (const char*)data + names.sh_offset + headers[i].sh_name;
+
+        section.name = std::string(name, strnlen(name, names.sh_size - headers[i].sh_name));
+        section.type = headers[i].sh_type;
+        section.flags = headers[i].sh_flags;
+        section.address = headers[i].sh_addr;
+        section.offset = headers[i].sh_offset;
+        section.size = headers[i].sh_type == SHT_NOBITS ? 0 : headers[i].sh_size;
+        section.link = headers[i].sh_link;
+
+        sections.push_back(section);
+    }
+}
+
+ElfFile::~ElfFile()
+{
+    if (data != NULL)
+        munmap((void*)data, length);
+}
+
+bool ElfFile::valid() const
+{
+    return message.empty();
+}
+
+const std::string& ElfFile::error() const
+{
+    return message;
+}
+
+void ElfFile::fail(const std::string& message)
+{
+    this->message = message;
+    sections.clear();
+}
+
+bool ElfFile::inFile(std::uint64_t offset, std::uint64_t size) const
+{
+    return offset <= length && size <= length - offset;
+}
+
+const ElfFile::Section* ElfFile::findSection(const std::string& name) const
+{
+    for (auto& it : sections)
+    {
+        if (it.name == name)
+            return &it;
+    }
+
+    return NULL;
+}
+
+std::string ElfFile::section(const std::string& name) const
+{
+    const Section* section = findSection(name);
+
+    if (section == NULL || !inFile(section->offset, section->size))
+        return "";
+
+    const char* contents = (const char*)data + section->offset;
+
+    if (!(section->flags & SHF_COMPRESSED))
+        return std::string(contents, section->size);
+
+    if (section->size < sizeof(Elf64_Chdr))
+        return "";
+
+    const Elf64_Chdr* compression = (const Elf64_Chdr*)contents;
+
+    if (compression->ch_type != ELFCOMPRESS_ZLIB)
+        return "";
+
+    std::string decompressed(compression->ch_size, '\0');
+    uLongf decompressedSize = compression->ch_size;
+
+    if (uncompress((Bytef*)&decompressed[0], &decompressedSize, (const Bytef*)contents + sizeof(Elf64_Chdr), section->size - sizeof(Elf64_Chdr)) != Z_OK)
+        return "";
+
+    decompressed.resize(decompressedSize);
+
+    return decompressed;
+}
+
+std::string ElfFile::buildId() const
+{
+    static const char digits[] = "0123456789abcdef";
+
+    for (auto& it : sections)
+    {
+        if (it.type != SHT_NOTE || !inFile(it.offset, it.size))
+            continue;
+
+        std::uint64_t offset = 0;
+
+        while (offset + sizeof(Elf64_Nhdr) <= it.size)
+        {
+            const Elf64_Nhdr* note = (const Elf64_Nhdr*)(data + it.offset + offset);
+            std::uint64_t name = offset + sizeof(Elf64_Nhdr);
+            std::uint64_t desc = name + ((note->n_namesz + 3) & ~3ULL);
+
+            offset = desc + ((note->n_descsz + 3) & ~3ULL);
+
+            if (offset > it.size)
+                break;
+
+            if (note->n_type != NT_GNU_BUILD_ID || note->n_namesz != 4 || memcmp(data + it.offset + name, "GNU", 4) != 0)
+                continue;
+
+            std::string id;
+
+            for (std::uint32_t i = 0; i < note->n_descsz; i++)
+            {
+                unsigned char byte = data[it.offset + desc + i];
+
+                id += digits[byte >> 4];
+                id += digits[byte & 0xf];
+            }
+
+            return id;
+        }
+    }
+
+    return "";
+}
+
+std::uint64_t ElfFile::size() const
+{
+    return length;
+}
+
+std::int64_t ElfFile::modificationTime() const
+{
+    return modified;
+}
+
+static int bindingRank(unsigned char binding)
+{
+    switch (binding)
+    {
+    case STB_GLOBAL:
+        return 0;
+    case STB_WEAK:
+        return 1;
+    default:
+        return 2;
+    }
+}
+
+std::vector<ElfSymbol> ElfFile::functions() const
+{
+    const Section* table = findSection(".symtab");
+
+    if (table == NULL)
+        table = findSection(".dynsym");
+
+    std::vector<ElfSymbol> functions;
+
+    if (table == NULL || table->link >= sections.size() || !inFile(table->offset, table->size))
+        return functions;
+
+    const Section& strings = sections[table->link];
+
+    if (!inFile(strings.offset, strings.size))
+        return functions;
+
+    const Elf64_Sym* symbols = (const Elf64_Sym*)(data + table->offset);
+    std::size_t count = table->size / sizeof(Elf64_Sym);
+
+    std::vector<std::pair<std::uint64_t, std::size_t> > order;
+
+    for (std::size_t i = 0; i < count; i++)
+    {
+        unsigned char type = ELF64_ST_TYPE(symbols[i].st_info);
+
+        if ((type != STT_FUNC && type != STT_GNU_IFUNC) || symbols[i].st_shndx == SHN_UNDEF || symbols[i].st_value == 0)
+            continue;
+
+        if (symbols[i].st_name >= strings.size)
+            continue;
+
+        order.push_back(std::make_pair(symbols[i].st_value, i));
+    }
+
+    std::stable_sort(order.begin(), order.end());
+
+    // Rank of the binding each function got its name from, aliases keep the strongest one
+    std::vector<int> ranks;
+
+    for (auto& it : order)
+    {
+        const Elf64_Sym& symbol = symbols[it.second];
+        const char* name = (const char*)data + strings.offset + symbol.st_name;
+        int rank = bindingRank(ELF64_ST_BIND(symbol.st_info));
+
+        if (!functions.empty() && functions.back().address == symbol.st_value)
+        {
+            if (rank < ranks.back())
+            {
+                functions.back().name = std::string(name, strnlen(name, strings.size - symbol.st_name));
+                ranks.back() = rank;
+            }
+
+            functions.back().size = std::max(functions.back().size, (std::uint64_t)symbol.st_size);
+
+            continue;
+        }
+
+        ElfSymbol function;
+
+        function.name = std::string(name, strnlen(name, strings.size - symbol.st_name));
+        function.address = symbol.st_value;
+        function.size = symbol.st_size;
+
+        functions.push_back(function);
+        ranks.push_back(rank);
+    }
+
+    // Symbols without a size reach up to the next one
+    for (std::size_t i = 0; i + 1 < functions.size(); i++)
+    {
+        if (functions[i].size == 0)
+            functions[i].size = functions[i + 1].address - functions[i].address;
+    }
+
+    return functions;
+}
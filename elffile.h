@@ -0,0 +1,65 @@
+#ifndef ELFFILE_H
+#define ELFFILE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* A function symbol, aliases at the same address are merged into the strongest binding */
+struct ElfSymbol
+{
+    std::string name;
+    std::uint64_t address;
+    std::uint64_t size;
+};
+
+/* Read only view of a 64 bit ELF file, mapped into memory */
+class ElfFile
+{
+public:
+    ElfFile(const std::string& path);
+    ~ElfFile();
+
+    ElfFile(const ElfFile&) = delete;
+
+    bool valid() const;
+    const std::string& error() const;
+
+    /* Contents of a section, decompressed if needed, empty if the section does not exist */
+    std::string section(const std::string& name) const;
+
+    /* Hex GNU build-id note, empty if the image has none */
+    std::string buildId() const;
+
+    /* File size and modification time in ns, 0 if the file could not be read */
+    std::uint64_t size() const;
+    std::int64_t modificationTime() const;
+
+    /* Functions from .symtab, or from .dynsym if the image is stripped, sorted by address */
+    std::vector<ElfSymbol> functions() const;
+
+private:
+    struct Section
+    {
+        std::string name;
+        std::uint32_t type;
+        std::uint64_t flags;
+        std::uint64_t address;
+        std::uint64_t offset;
+        std::uint64_t size;
+        std::uint32_t link;
+    };
+
+    const Section* findSection(const std::string& name) const;
+    bool inFile(std::uint64_t offset, std::uint64_t size) const;
+    void fail(const std::string& message);
+
+    const unsigned char* data;
+    std::size_t length;
+    std::int64_t modified;
+
+    std::vector<Section> sections;
+    std::string message;
+};
+
+#endif // ELFFILE_H
@@ -21,6 +21,11 @@ class Image
 public:
     int id;
     std::string name;
+
+    /* Identity of the file the image was indexed from, empty and 0 when it could not be read */
+    std::string buildId;
+    INT64 size;
+    INT64 modificationTime;
 };
 
 class File
@@ -129,6 +134,25 @@ public:
     UINT64 start, end;
 };
 
+class CCTNode : public EntityWithGeneratedId
+{
+public:
+    int parent;
+    int thread;
+    int function;
+    int segment;
+
+    /* Location of the call instruction in the parent, -1 for roots */
+    int callLine;
+    int callColumn;
+
+    UINT64 count;
+    UINT64 inclusive;
+    UINT64 exclusive;
+    UINT64 minDuration;
+    UINT64 maxDuration;
+};
+
 enum class SegmentType
 {
     Standard = 0,
@@ -143,6 +167,71 @@ public:
     SegmentType type;
 };
 
+/* Loop found by a back edge in a function, the header is the target of the back edge */
+class LoopHeader
+{
+public:
+    int id;
+
+    int function;
+    int line;
+    int column;
+};
+
+/* One execution of a loop, iterations are aggregated unless they get their own segments */
+class LoopExecutionSummary : public EntityWithGeneratedId
+{
+public:
+    int loop;
+    int thread;
+    int segment;
+
+    UINT64 start;
+    UINT64 end;
+
+    UINT64 iterations;
+    UINT64 minIteration;
+    UINT64 maxIteration;
+
+    /* Accesses depending on an earlier iteration of the same execution, -1 distance if none */
+    UINT64 dependencies;
+    int minDistance;
+};
+
+class LoopIterationSegment
+{
+public:
+    int execution;
+    int iteration;
+    int segment;
+
+    UINT64 start;
+    UINT64 end;
+};
+
+/* Access sampling of the run, a thread records the first burst of every period memory instructions it executes,
+ * access counts scale by period / burst */
+class AccessSampling
+{
+public:
+    /* 0 if every memory instruction is recorded */
+    UINT64 period;
+    UINT64 burst;
+
+    /* 0 if the overhead control is off */
+    UINT64 slowdownBudget;
+};
+
+/* Memory instructions of a segment executed while accesses were sampled, counts of the segment scale by accesses / sampled */
+class SegmentSampling
+{
+public:
+    int segment;
+
+    UINT64 accesses;
+    UINT64 sampled;
+};
+
 enum class InstructionType
 {
     Call    = 0,
@@ -198,6 +287,21 @@ public:
     int size;
 };
 
+/* Accesses of one instruction to one reference inside a segment */
+class AccessSummary : public EntityWithGeneratedId {
+public:
+    int instruction;
+    int reference;
+
+    UINT64 reads;
+    UINT64 writes;
+    UINT64 readBytes;
+    UINT64 writeBytes;
+
+    UINT64 firstTSC;
+    UINT64 lastTSC;
+};
+
 enum class ReferenceType {
     Stack = 1,
     Heap = 2,
@@ -210,11 +314,18 @@ enum class ReferenceType {
 
 class Reference : public EntityWithGeneratedId {
 public:
+    /* Only set for references without an address, the others are named by the ReferenceName view */
     std::string name;
     int size;
     ReferenceType type;
     int allocator;
     int deallocator;
+
+    ADDRINT address;
+
+    /* Stack and parameter references, relative to the frame of function */
+    ADDRDELTA stackDelta;
+    int function;
 };
 
 struct Conflict {
@@ -224,6 +335,33 @@ struct Conflict {
     int tagInstance2;
     int access1;
     int access2;
+
+    /* Not stored, used when conflicts are summarized */
+    AccessType type1;
+    AccessType type2;
+};
+
+/* All conflicts between two tag instances on one reference with the same access types */
+struct ConflictSummary {
+    int id;
+
+    int tagInstance1;
+    int tagInstance2;
+    int reference;
+
+    AccessType type1;
+    AccessType type2;
+
+    UINT64 count;
+
+    int firstAccess1;
+    int firstAccess2;
+    int lastAccess1;
+    int lastAccess2;
+
+    /* Bytes touched by the conflicting accesses, [lowAddress, highAddress) */
+    UINT64 lowAddress;
+    UINT64 highAddress;
 };
 
 namespace std
@@ -239,6 +377,12 @@ struct hash<SourceLocation>
 }
 
 
+/* An unreadable image never matches, it is indexed again */
+inline bool sameFingerprint(const Image & lhs, const Image & rhs)
+{
+    return lhs.size > 0 && std::tie(lhs.buildId, lhs.size, lhs.modificationTime) == std::tie(rhs.buildId, rhs.size, rhs.modificationTime);
+}
+
 inline bool operator==(const SourceLocation & lhs, const SourceLocation & rhs )
 {
     return std::tie(lhs.function, lhs.line, lhs.column) == std::tie(rhs.function, rhs.line, rhs.column);
@@ -1,5 +1,7 @@
 #include "filter.h"
 
+#include <algorithm>
+#include <cctype>
 #include <exception>
 #include <iostream>
 
@@ -16,6 +18,12 @@ Filter::Filter(std::string file)
 
     for (auto it : filter)
     {
+        if (it.first.as<std::string>() == "ranges")
+        {
+            addRanges(file, it.second);
+            continue;
+        }
+
         if(!it.second.IsMap())
             YAMLException(file, "Filter file should be a map of maps");
 
@@ -23,8 +31,6 @@ Filter::Filter(std::string file)
 
         FilterData filterdata;
 
-
-
         if (it.second["include"])
         {
             if(!it.second["include"].IsSequence())
@@ -32,73 +38,529 @@ Filter::Filter(std::string file)
 
             for (auto it2 : it.second["include"])
             {
-                std::cout << it2.as<std::string>() << std::endl;
-                filterdata.include.push_back(std::regex(it2.as<std::string>(), std::regex_constants::basic));
+                filterdata.include.add(it2.as<std::string>(), std::regex_constants::basic);
             }
         }
-        else
-        {
-
-        }
-
 
         if (it.second["exclude"])
         {
             if(!it.second["exclude"].IsSequence())
                 YAMLException(file, "'exclude' should be a sequence");
 
-
             for (auto it2 : it.second["exclude"])
             {
-                filterdata.exclude.push_back(std::regex(it2.as<std::string>()));
+                filterdata.exclude.add(it2.as<std::string>(), std::regex_constants::ECMAScript);
             }
-
         }
 
+        filterdata.include.compile();
+        filterdata.exclude.compile();
+
         filters.insert(std::make_pair(name, filterdata));
     }
+
+    this->image = findFilter("image");
+    this->file = findFilter("file");
+    this->function = findFilter("function");
+}
+
+static std::uint64_t parseAddress(const std::string& file, const YAML::Node& node)
+{
+    std::string text = node.as<std::string>();
+
+    try
+    {
+        std::size_t end;
+        std::uint64_t address = std::stoull(text, &end, 0);
+
+        if (end == text.size())
+            return address;
+    }
+    catch (std::exception&)
+    {
+    }
+
+    YAMLException(file, "'" + text + "' is not an address");
+
+    return 0;
+}
+
+/* ranges: {image: [{start: offset, end: offset}, ...]}, offsets as in the image file (objdump, addr2line) */
+void Filter::addRanges(const std::string& file, const YAML::Node& node)
+{
+    if(!node.IsMap())
+        YAMLException(file, "'ranges' should be a map of images");
+
+    for (auto it : node)
+    {
+        if(!it.second.IsSequence())
+            YAMLException(file, "'ranges' of an image should be a sequence");
+
+        AddressRanges& imageRanges = ranges[it.first.as<std::string>()];
+
+        for (auto it2 : it.second)
+        {
+            if(!it2.IsMap() || !it2["start"] || !it2["end"])
+                YAMLException(file, "A range should be a map with 'start' and 'end'");
+
+            std::uint64_t start = parseAddress(file, it2["start"]);
+            std::uint64_t end = parseAddress(file, it2["end"]);
+
+            if (end <= start)
+                YAMLException(file, "A range should end after its start");
+
+            imageRanges.add(start, end);
+        }
+
+        imageRanges.compile();
+    }
+}
+
+const AddressRanges* Filter::findImageRanges(const std::string& image) const
+{
+    auto it = ranges.find(image);
+
+    if (it == ranges.end())
+    {
+        std::size_t slash = image.rfind('/');
+
+        if (slash != std::string::npos)
+            it = ranges.find(image.substr(slash + 1));
+    }
+
+    if (it == ranges.end())
+        return NULL;
+
+    return &it->second;
+}
+
+FilterData* Filter::findFilter(const std::string& type)
+{
+    auto it = filters.find(type);
+
+    if (it == filters.end())
+        return NULL;
+
+    return &it->second;
 }
 
 bool Filter::isImageFiltered(const std::string& image)
 {
-    return isFiltered("image", image);
+    return isFiltered(this->image, image);
 }
 
 bool Filter::isFileFiltered(const std::string& file)
 {
-    return isFiltered("file", file);
+    return isFiltered(this->file, file);
 }
 
 bool Filter::isFunctionFiltered(const std::string& function)
 {
-    return isFiltered("function", function);
+    return isFiltered(this->function, function);
 }
 
 bool Filter::isFiltered(const std::string& type, const std::string& content)
 {
-    FilterData& filterdata = filters[type];
+    return isFiltered(findFilter(type), content);
+}
+
+bool Filter::isFiltered(FilterData* filterdata, const std::string& content)
+{
+    if (filterdata == NULL)
+        return false;
+
+    auto it = filterdata->decisions.find(content);
+
+    if (it != filterdata->decisions.end())
+        return it->second;
+
+    bool filtered = (!filterdata->include.empty() && !filterdata->include.matches(content)) || filterdata->exclude.matches(content);
+
+    filterdata->decisions.insert(std::make_pair(content, filtered));
+
+    return filtered;
+}
+
+/* Longest literal run every match of pattern has to contain, empty when the pattern is too complex */
+static std::string requiredLiteral(const std::string& pattern, std::regex_constants::syntax_option_type grammar)
+{
+    if (pattern.find_first_of("(){}|") != std::string::npos)
+        return "";
+
+    // Escaped braces are groups and intervals in the basic grammar
+    if (grammar == std::regex_constants::basic && (pattern.find("\\(") != std::string::npos || pattern.find("\\{") != std::string::npos))
+        return "";
 
-    bool included = false;
+    std::string best, run;
 
-    for (auto it : filterdata.include)
+    for (std::size_t i = 0; i < pattern.size(); i++)
     {
-        if (std::regex_search(content, it))
+        char c = pattern[i];
+
+        if (c == '\\' && i + 1 < pattern.size() && !isalnum(pattern[i + 1]))
+        {
+            run += pattern[++i];
+        }
+        else if (c == '*' || c == '?')
+        {
+            // The previous character is optional
+            if (!run.empty())
+                run.erase(run.size() - 1);
+
+            if (run.size() > best.size())
+                best = run;
+
+            run.clear();
+        }
+        else if (c == '\\' || c == '[' || c == '.' || c == '^' || c == '$' || c == '+')
+        {
+            if (run.size() > best.size())
+                best = run;
+
+            run.clear();
+
+            if (c == '\\')
+            {
+                i++;
+            }
+            else if (c == '[')
+            {
+                std::size_t end = pattern.find(']', i + (i + 1 < pattern.size() && pattern[i + 1] == '^' ? 3 : 2));
+
+                if (end == std::string::npos)
+                    return "";
+
+                i = end;
+            }
+        }
+        else
         {
-            included = true;
-            break;
+            run += c;
         }
     }
 
-    if (!included && filterdata.include.size() > 0)
-        return true;
+    if (run.size() > best.size())
+        best = run;
+
+    return best;
+}
+
+PatternSet::PatternSet() : count(0), hasAlternation(false), alternativesGuarded(true)
+{
+}
 
-    for (auto it : filterdata.exclude)
+void PatternSet::add(const std::string& pattern, std::regex_constants::syntax_option_type grammar)
+{
+    count++;
+
+    std::string literal = pattern;
+
+    bool anchoredStart = !literal.empty() && literal[0] == '^';
+    if (anchoredStart)
+        literal.erase(0, 1);
+
+    bool anchoredEnd = !literal.empty() && literal[literal.size() - 1] == '$' && (literal.size() < 2 || literal[literal.size() - 2] != '\\');
+    if (anchoredEnd)
+        literal.erase(literal.size() - 1);
+
+    // Characters special in either grammar, anything else matches itself
+    if (literal.find_first_of(".[]*+?(){}|^$\\") != std::string::npos)
     {
-        if (std::regex_search(content, it))
+        bool backreference = false;
+
+        for (std::size_t i = 0; i + 1 < pattern.size(); i++)
         {
+            if (pattern[i] == '\\' && isdigit(pattern[i + 1]))
+                backreference = true;
+        }
+
+        std::string guard = requiredLiteral(pattern, grammar);
+
+        // Group numbers change in an alternation
+        if (grammar == std::regex_constants::ECMAScript && !backreference)
+        {
+            alternatives.push_back(pattern);
+
+            if (guard.empty())
+                alternativesGuarded = false;
+            else
+                alternativeGuards.insert(guard);
+        }
+        else
+        {
+            regexes.push_back(std::regex(pattern, grammar));
+            guards.push_back(guard);
+        }
+
+        return;
+    }
+
+    if (anchoredStart && anchoredEnd)
+        exact.insert(literal);
+    else if (anchoredStart)
+        prefixes.insert(literal);
+    else if (anchoredEnd)
+        suffixes.insert(std::string(literal.rbegin(), literal.rend()));
+    else
+        substrings.insert(literal);
+}
+
+void PatternSet::compile()
+{
+    substrings.build();
+
+    if (alternatives.empty())
+        return;
+
+    std::string combined;
+
+    for (auto& it : alternatives)
+    {
+        if (!combined.empty())
+            combined += '|';
+
+        combined += "(?:" + it + ")";
+    }
+
+    alternation = std::regex(combined, std::regex_constants::ECMAScript | std::regex_constants::nosubs | std::regex_constants::optimize);
+    hasAlternation = true;
+    alternatives.clear();
+
+    alternativeGuards.build();
+}
+
+bool PatternSet::empty() const
+{
+    return count == 0;
+}
+
+bool PatternSet::matches(const std::string& content) const
+{
+    if (!exact.empty() && exact.find(content) != exact.end())
+        return true;
+
+    if (!prefixes.empty() && prefixes.matchesStart(content, false))
+        return true;
+
+    if (!suffixes.empty() && suffixes.matchesStart(content, true))
+        return true;
+
+    if (!substrings.empty() && substrings.matchesAnywhere(content))
+        return true;
+
+    for (std::size_t i = 0; i < regexes.size(); i++)
+    {
+        if (!guards[i].empty() && content.find(guards[i]) == std::string::npos)
+            continue;
+
+        if (std::regex_search(content, regexes[i]))
             return true;
+    }
+
+    if (!hasAlternation)
+        return false;
+
+    if (alternativesGuarded && !alternativeGuards.matchesAnywhere(content))
+        return false;
+
+    return std::regex_search(content, alternation);
+}
+
+LiteralTrie::LiteralTrie()
+{
+    nodes.push_back(Node());
+    nodes[0].fail = 0;
+    nodes[0].terminal = false;
+    nodes[0].output = false;
+}
+
+void LiteralTrie::insert(const std::string& pattern)
+{
+    int node = 0;
+
+    for (unsigned char c : pattern)
+    {
+        int next = child(node, c);
+
+        if (next < 0)
+        {
+            next = nodes.size();
+
+            Node created;
+            created.fail = 0;
+            created.terminal = false;
+            created.output = false;
+
+            nodes.push_back(created);
+            nodes[node].next.insert(std::make_pair(c, next));
         }
+
+        node = next;
+    }
+
+    nodes[node].terminal = true;
+    nodes[node].output = true;
+}
+
+/* Failure links in breadth first order, a node outputs if it or a suffix of it is a pattern */
+void LiteralTrie::build()
+{
+    std::vector<int> queue;
+
+    for (auto& it : nodes[0].next)
+    {
+        nodes[it.second].fail = 0;
+        queue.push_back(it.second);
+    }
+
+    for (std::size_t i = 0; i < queue.size(); i++)
+    {
+        int node = queue[i];
+
+        for (auto& it : nodes[node].next)
+        {
+            int fail = nodes[node].fail;
+
+            while (fail != 0 && child(fail, it.first) < 0)
+                fail = nodes[fail].fail;
+
+            int target = child(fail, it.first);
+
+            nodes[it.second].fail = target >= 0 && target != it.second ? target : 0;
+            nodes[it.second].output = nodes[it.second].terminal || nodes[nodes[it.second].fail].output;
+
+            queue.push_back(it.second);
+        }
+    }
+}
+
+bool LiteralTrie::empty() const
+{
+    return nodes.size() == 1 && !nodes[0].terminal;
+}
+
+int LiteralTrie::child(int node, unsigned char c) const
+{
+    auto it = nodes[node].next.find(c);
+
+    if (it == nodes[node].next.end())
+        return -1;
+
+    return it->second;
+}
+
+bool LiteralTrie::matchesStart(const std::string& content, bool backwards) const
+{
+    int node = 0;
+
+    if (nodes[0].terminal)
+        return true;
+
+    for (std::size_t i = 0; i < content.size(); i++)
+    {
+        node = child(node, backwards ? content[content.size() - 1 - i] : content[i]);
+
+        if (node < 0)
+            return false;
+
+        if (nodes[node].terminal)
+            return true;
+    }
+
+    return false;
+}
+
+bool LiteralTrie::matchesAnywhere(const std::string& content) const
+{
+    int node = 0;
+
+    if (nodes[0].terminal)
+        return true;
+
+    for (unsigned char c : content)
+    {
+        while (node != 0 && child(node, c) < 0)
+            node = nodes[node].fail;
+
+        int next = child(node, c);
+
+        node = next < 0 ? 0 : next;
+
+        if (nodes[node].output)
+            return true;
     }
 
     return false;
 }
+
+AddressRanges::AddressRanges() : sorted(true)
+{
+}
+
+void AddressRanges::add(std::uint64_t start, std::uint64_t end)
+{
+    intervals.push_back(std::make_pair(start, end));
+    sorted = false;
+}
+
+void AddressRanges::add(const AddressRanges& ranges, std::uint64_t offset)
+{
+    for (auto& it : ranges.intervals)
+        add(it.first + offset, it.second + offset);
+}
+
+/* Sort and merge overlapping intervals, contains() needs a sorted disjoint list */
+void AddressRanges::compile()
+{
+    if (sorted)
+        return;
+
+    std::sort(intervals.begin(), intervals.end());
+
+    std::size_t merged = 0;
+
+    for (std::size_t i = 1; i < intervals.size(); i++)
+    {
+        if (intervals[i].first <= intervals[merged].second)
+            intervals[merged].second = std::max(intervals[merged].second, intervals[i].second);
+        else
+            intervals[++merged] = intervals[i];
+    }
+
+    if (!intervals.empty())
+        intervals.resize(merged + 1);
+
+    sorted = true;
+}
+
+bool AddressRanges::empty() const
+{
+    return intervals.empty();
+}
+
+bool AddressRanges::contains(std::uint64_t address) const
+{
+    // First interval starting after address, the one before it is the only candidate
+    auto it = std::upper_bound(intervals.begin(), intervals.end(), std::make_pair(address, UINT64_MAX));
+
+    if (it == intervals.begin())
+        return false;
+
+    --it;
+
+    return address < it->second;
+}
+
+/* Whether any interval intersects [start, end) */
+bool AddressRanges::overlaps(std::uint64_t start, std::uint64_t end) const
+{
+    // First interval starting at or after end, the one before it ends last among the candidates
+    auto it = std::lower_bound(intervals.begin(), intervals.end(), std::make_pair(end, std::uint64_t(0)));
+
+    if (it == intervals.begin())
+        return false;
+
+    --it;
+
+    return start < it->second;
+}
@@ -1,21 +1,112 @@
 #ifndef FILTER_H
 #define FILTER_H
 
+#include <cstdint>
 #include <regex>
 #include <vector>
 #include <map>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace YAML
+{
+class Node;
+}
+
+/* Trie of literal patterns, with failure links it also finds them anywhere in a string (Aho-Corasick) */
+class LiteralTrie
+{
+public:
+    LiteralTrie();
+
+    void insert(const std::string& pattern);
+    void build();
+
+    bool empty() const;
+
+    /* A pattern is a prefix of content, or a suffix when reading content backwards */
+    bool matchesStart(const std::string& content, bool backwards) const;
+    bool matchesAnywhere(const std::string& content) const;
+
+private:
+    struct Node
+    {
+        std::map<unsigned char, int> next;
+        int fail;
+        bool terminal;
+        bool output;
+    };
+
+    int child(int node, unsigned char c) const;
+
+    std::vector<Node> nodes;
+};
+
+/* Patterns of one include or exclude list, literals are matched without running a regex */
+class PatternSet
+{
+public:
+    PatternSet();
+
+    void add(const std::string& pattern, std::regex_constants::syntax_option_type grammar);
+    void compile();
+
+    bool empty() const;
+    bool matches(const std::string& content) const;
+
+private:
+    std::size_t count;
+
+    std::unordered_set<std::string> exact;
+    LiteralTrie prefixes;
+    LiteralTrie suffixes;
+    LiteralTrie substrings;
+
+    /* ECMAScript patterns are combined into one alternation, basic ones have no alternation */
+    std::vector<std::string> alternatives;
+    std::vector<std::regex> regexes;
+    std::regex alternation;
+    bool hasAlternation;
+
+    /* A regex only runs if content contains a literal every match of it contains, empty if unknown */
+    std::vector<std::string> guards;
+    LiteralTrie alternativeGuards;
+    bool alternativesGuarded;
+};
+
+/* Sorted, disjoint [start, end) address intervals */
+class AddressRanges
+{
+public:
+    AddressRanges();
+
+    void add(std::uint64_t start, std::uint64_t end);
+    void add(const AddressRanges& ranges, std::uint64_t offset);
+    void compile();
+
+    bool empty() const;
+    bool contains(std::uint64_t address) const;
+    bool overlaps(std::uint64_t start, std::uint64_t end) const;
+
+private:
+    std::vector<std::pair<std::uint64_t, std::uint64_t> > intervals;
+    bool sorted;
+};
 
 struct FilterData
 {
-    std::vector<std::regex> include;
-    std::vector<std::regex> exclude;
+    PatternSet include;
+    PatternSet exclude;
+
+    std::unordered_map<std::string, bool> decisions;
 };
 
 class Filter
 {
 public:
     Filter(std::string file);
+    Filter(const Filter&) = delete;
 
     bool isImageFiltered(const std::string& image);
     bool isFileFiltered(const std::string& file);
@@ -23,8 +114,21 @@ public:
 
     bool isFiltered(const std::string& type, const std::string& content);
 
+    /* Filtered offsets inside an image, matched by path or file name, NULL if there are none */
+    const AddressRanges* findImageRanges(const std::string& image) const;
+
 private:
+    FilterData* findFilter(const std::string& type);
+    void addRanges(const std::string& file, const YAML::Node& node);
+    bool isFiltered(FilterData* filterdata, const std::string& content);
+
     std::map<std::string, FilterData> filters;
+    std::map<std::string, AddressRanges> ranges;
+
+    /* The types checked for every routine, looked up once */
+    FilterData* image;
+    FilterData* file;
+    FilterData* function;
 };
 
 #endif // FILTER_H
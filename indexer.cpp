@@ -0,0 +1,406 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <cxxabi.h>
+
+#include <pin.H>
+
+#include "sqlwriter.h"
+#include "filter.h"
+#include "elffile.h"
+#include "dwarfline.h"
+
+/* Writes the same Image, File, Function and SourceLocation rows as the static pintool, from the ELF symbol
+ * tables and DWARF line programs of the images, without running the program */
+
+struct IndexedFunction
+{
+    std::string name;
+    std::string prototype;
+    std::string file;
+    int line;
+
+    std::vector<std::pair<int, int> > locations;
+};
+
+struct IndexedImage
+{
+    Image image;
+    std::string error;
+
+    /* The fingerprint matches the one of a previous run, nothing was parsed */
+    bool unchanged;
+
+    std::vector<IndexedFunction> functions;
+};
+
+struct Options
+{
+    std::string db;
+    std::string filter;
+    DatabaseOptions database;
+    unsigned threads;
+
+    std::vector<std::string> images;
+};
+
+/* PIN_UndecorateSymbolName, the name only form drops the return type, parameters and qualifiers */
+std::string undecorate(const std::string& symbol, bool nameOnly)
+{
+    int status;
+    char* demangled = abi::__cxa_demangle(symbol.c_str(), NULL, NULL, &status);
+
+    if (status != 0 || demangled == NULL)
+        return symbol;
+
+    std::string prototype = demangled;
+    free(demangled);
+
+    if (!nameOnly)
+        return prototype;
+
+    std::size_t close = prototype.rfind(')');
+
+    if (close == std::string::npos)
+        return prototype;
+
+    int depth = 0;
+    std::size_t open = close;
+
+    for (;; open--)
+    {
+        char c = prototype[open];
+
+        if (c == ')' || c == '>' || c == ']' || c == '}')
+            depth++;
+        else if (c == '(' || c == '<' || c == '[' || c == '{')
+            depth--;
+
+        if (depth == 0 || open == 0)
+            break;
+    }
+
+    std::string name = prototype.substr(0, open);
+
+    depth = 0;
+
+    for (std::size_t i = name.size(); i > 0; i--)
+    {
+        char c = name[i - 1];
+
+        if (c == ')' || c == '>' || c == ']' || c == '}')
+            depth++;
+        else if (c == '(' || c == '<' || c == '[' || c == '{')
+            depth--;
+        else if (c == ' ' && depth == 0)
+        {
+            // Operator new and conversion operators have a space in their name
+            if (i >= 9 && name.compare(i - 9, 8, "operator") == 0)
+                continue;
+
+            return name.substr(i);
+        }
+    }
+
+    return name;
+}
+
+std::unique_ptr<IndexedImage> indexImage(const std::string& path, const std::map<std::string, Image>& indexedImages)
+{
+    std::unique_ptr<IndexedImage> image(new IndexedImage);
+
+    image->image.name = path;
+    image->unchanged = false;
+
+    ElfFile elf(path);
+
+    if (!elf.valid())
+    {
+        image->error = elf.error();
+        return image;
+    }
+
+    image->image.buildId = elf.buildId();
+    image->image.size = elf.size();
+    image->image.modificationTime = elf.modificationTime();
+
+    auto indexed = indexedImages.find(path);
+
+    if (indexed != indexedImages.end() && sameFingerprint(indexed->second, image->image))
+    {
+        image->unchanged = true;
+        return image;
+    }
+
+    LineTable lines(elf);
+
+    std::vector<ElfSymbol> symbols = elf.functions();
+
+    image->functions.reserve(symbols.size());
+
+    for (auto& it : symbols)
+    {
+        IndexedFunction function;
+
+        function.name = undecorate(it.name, true);
+        function.prototype = undecorate(it.name, false);
+
+        int column;
+        lines.lookup(it.address, &column, &function.line, &function.file);
+
+        std::vector<const LineRow*> rows = lines.rows(it.address, it.address + std::max(it.size, (std::uint64_t)1));
+
+        // Instructions without a row have line and column 0
+        if (rows.empty() || rows[0]->address > it.address)
+            function.locations.push_back(std::make_pair(0, 0));
+
+        for (auto row : rows)
+            function.locations.push_back(std::make_pair(row->line, row->column));
+
+        image->functions.push_back(function);
+    }
+
+    return image;
+}
+
+void writeImage(SQLWriter* writer, Filter* filter, const IndexedImage& indexed)
+{
+    Image image = indexed.image;
+
+    writer->insertImage(image);
+
+    std::map<std::string, File> files;
+    std::map<std::tuple<std::string, std::string, int, int>, int> functions;
+    std::set<SourceLocation> foundLocations;
+
+    for (auto& it : indexed.functions)
+    {
+        if (filter->isFunctionFiltered(it.name) || filter->isFunctionFiltered(it.prototype))
+            continue;
+
+        std::string file = it.file.empty() ? "Unknown" : it.file;
+
+        if (files.find(file) == files.end())
+        {
+            if (filter->isFileFiltered(file))
+                continue;
+
+            files[file].name = file;
+            files[file].image = image.id;
+
+            writer->insertFile(files[file]);
+        }
+
+        Function function;
+
+        function.name = it.name;
+        function.prototype = it.prototype;
+        function.file = files[file].id;
+        function.line = it.line;
+
+        auto key = std::make_tuple(function.name, function.prototype, function.file, function.line);
+        auto existing = functions.find(key);
+
+        if (existing == functions.end())
+        {
+            writer->insertFunction(function);
+            functions.insert(std::make_pair(key, function.id));
+        }
+        else
+        {
+            function.id = existing->second;
+        }
+
+        for (auto& location : it.locations)
+        {
+            SourceLocation sourceLocation;
+
+            sourceLocation.function = function.id;
+            sourceLocation.line = location.first;
+            sourceLocation.column = location.second;
+
+            if (foundLocations.insert(sourceLocation).second)
+                writer->insertSourceLocation(sourceLocation);
+        }
+    }
+
+    writer->checkMemoryLimit();
+}
+
+int usage()
+{
+    cerr << "Usage: pintool_indexer [-db data.db] [-filter filter.yaml] [-db-mode file|memory] [-db-memory-limit MB] [-db-backup-step pages] [-j threads] image..." << endl;
+    cerr << "Images are named by the paths given, use the paths the program loads them from." << endl;
+
+    return -1;
+}
+
+bool parseOptions(int argc, char* argv[], Options* options)
+{
+    options->db = "data.db";
+    options->filter = "filter.yaml";
+    options->threads = std::max(1u, std::thread::hardware_concurrency());
+
+    std::string mode = "file";
+    UINT64 memoryLimit = 4096;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+
+        if (arg[0] != '-')
+        {
+            options->images.push_back(arg);
+            continue;
+        }
+
+        if (i + 1 >= argc)
+            return false;
+
+        std::string value = argv[++i];
+
+        if (arg == "-db")
+            options->db = value;
+        else if (arg == "-filter")
+            options->filter = value;
+        else if (arg == "-db-mode")
+            mode = value;
+        else if (arg == "-db-memory-limit")
+            memoryLimit = strtoull(value.c_str(), NULL, 10);
+        else if (arg == "-db-backup-step")
+            options->database.backupPagesPerStep = atoi(value.c_str());
+        else if (arg == "-j")
+            options->threads = std::max(1, atoi(value.c_str()));
+        else
+            return false;
+    }
+
+    options->database.mode = parseDatabaseMode(mode);
+    options->database.memoryLimit = memoryLimit * 1024 * 1024;
+
+    // Indexing unchanged images again must not lose what the dynamic tool wrote, a changed image resets it
+    options->database.resetDynamicTables = false;
+
+    return !options->images.empty();
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+
+    if (!parseOptions(argc, argv, &options))
+        return usage();
+
+    auto begin = std::chrono::steady_clock::now();
+
+    // An existing database is updated, only images whose file changed are indexed again
+    bool exists = access(options.db.c_str(), F_OK) != -1;
+
+    std::unique_ptr<SQLWriter> writer(new SQLWriter(options.db, !exists, options.database));
+    std::unique_ptr<Filter> filter(new Filter(options.filter));
+
+    std::map<std::string, Image> indexedImages;
+
+    for (auto& it : writer->getImages())
+    {
+        auto inserted = indexedImages.insert(std::make_pair(it.name, it));
+
+        // Images indexed twice are never considered unchanged
+        if (!inserted.second)
+            inserted.first->second.size = 0;
+    }
+
+    std::vector<std::string> images;
+
+    for (auto& it : options.images)
+    {
+        if (filter->isImageFiltered(it))
+            cerr << "Skipping image:" << it << endl;
+        else
+            images.push_back(it);
+    }
+
+    // Workers parse images in parallel, rows are written by this thread in the order the images were given
+    std::vector<std::unique_ptr<IndexedImage> > indexed(images.size());
+    std::atomic<std::size_t> nextImage(0);
+    std::mutex mutex;
+    std::condition_variable ready;
+
+    std::vector<std::thread> workers;
+
+    for (unsigned i = 0; i < std::min<std::size_t>(options.threads, images.size()); i++)
+    {
+        workers.push_back(std::thread([&]()
+        {
+            for (std::size_t image = nextImage++; image < images.size(); image = nextImage++)
+            {
+                std::unique_ptr<IndexedImage> result = indexImage(images[image], indexedImages);
+
+                std::lock_guard<std::mutex> guard(mutex);
+
+                indexed[image] = std::move(result);
+                ready.notify_all();
+            }
+        }));
+    }
+
+    std::size_t reindexed = 0;
+
+    for (std::size_t i = 0; i < images.size(); i++)
+    {
+        std::unique_ptr<IndexedImage> image;
+
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+
+            ready.wait(guard, [&]() { return indexed[i] != NULL; });
+
+            image = std::move(indexed[i]);
+        }
+
+        if (!image->error.empty())
+        {
+            Warn("Skipping image", image->error);
+            continue;
+        }
+
+        if (image->unchanged)
+        {
+            cerr << "Unchanged image:" << image->image.name << endl;
+            continue;
+        }
+
+        fprintf(stderr, "Processing %s\n", image->image.name.c_str());
+
+        if (indexedImages.find(image->image.name) != indexedImages.end())
+            writer->deleteImage(image->image.name);
+
+        writeImage(writer.get(), filter.get(), *image);
+        reindexed++;
+    }
+
+    for (auto& it : workers)
+        it.join();
+
+    writer.reset();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    fprintf(stderr, "Indexed %zu of %zu images in %.2f s\n", reindexed, images.size(), seconds);
+
+    return 0;
+}
@@ -1,17 +1,35 @@
 #include "manager.h"
 
+#include <errno.h>
+#include <string.h>
+
+#include <iostream>
+
 #include <yaml-cpp/yaml.h>
 
 #include "exception.h"
 
-Manager::Manager(const string &db, const string &source, const string &filter) : writer(db), filter(filter)
+Manager::Manager(const string &db, const string &source, const string &filter, const DatabaseOptions& options) : writer(db, false, options), filter(filter)
 {
     PIN_MutexInit(&mutex);
     PIN_MutexInit(&knownAllocationsLock);
+    PIN_MutexInit(&referencesLock);
 
     processAccessesByDefault = false;
     processCallsByDefault = true;
 
+    aggregateCalls = false;
+    aggregateAccesses = false;
+    summarizeConflicts = false;
+    detectLoops = false;
+    loopIterationSegments = false;
+    dropRedZoneWrites = false;
+    batchAccesses = false;
+    slowdownBudget = 0;
+
+    telemetry = NULL;
+    referenceCount = 0;
+
     loadTags(source);
     writeTags();
 
@@ -22,6 +40,52 @@ Manager::Manager(const string &db, const string &source, const string &filter) :
     writeRedZone();
 }
 
+Manager::~Manager()
+{
+#ifdef PINTOOL_STATS
+    toolStats.add(writer.toolStats);
+
+    writer.insertToolStats(-1, toolStats);
+
+    std::cerr << "Tool profile:" << std::endl << toolStats.summary();
+#endif
+
+    // The page stays behind with the final values
+    if (telemetry != NULL)
+    {
+        writer.publishRows(NULL);
+        closeTelemetryPage(telemetry);
+    }
+}
+
+void Manager::writeToolStats(int thread, const ToolStats& stats)
+{
+    writer.insertToolStats(thread, stats);
+
+    toolStats.add(stats);
+}
+
+void Manager::publishTelemetry(const std::string& file)
+{
+    telemetry = createTelemetryPage(file);
+
+    if (telemetry == NULL)
+    {
+        Warn("publishTelemetry", "cannot create " + file + ": " + strerror(errno));
+        return;
+    }
+
+    writer.publishRows(&telemetry->header.rows);
+}
+
+TelemetryThread* Manager::getTelemetryThread(THREADID tid)
+{
+    if (telemetry == NULL || tid >= telemetryThreads)
+        return NULL;
+
+    return &telemetry->threads[tid];
+}
+
 int Manager::getLocation(ADDRINT address, int functionId)
 {
     LocationDetails detail;
@@ -53,6 +117,8 @@ void Manager::bufferFull(BufferEntry* entries, UINT64 count, THREADID tid)
     unlock();
 
     manager.bufferFull(entries, count);
+
+    writer.checkMemoryLimit();
 }
 
 void Manager::setUpThreadManager(THREADID tid)
@@ -313,6 +379,9 @@ void Manager::writeRedZone()
     redZone.ref.type = ReferenceType::RedZone;
     redZone.ref.name = "Red Zone";
     redZone.ref.size = 128;
+    redZone.ref.address = 0;
+    redZone.ref.stackDelta = 0;
+    redZone.ref.function = -1;
 
     writer.insertReference(redZone.ref);
 }
@@ -1,6 +1,7 @@
 #ifndef MANAGER_H
 #define MANAGER_H
 
+#include <deque>
 #include <unordered_map>
 #include <map>
 #include <set>
@@ -10,6 +11,7 @@
 class Manager;
 struct MemoryOperationDetails;
 struct AccessInstructionDetails;
+struct BlockAccessDetails;
 struct LocationDetails;
 struct ReferenceData;
 
@@ -18,6 +20,7 @@ struct ReferenceData;
 #include "filter.h"
 #include "buffer.h"
 #include "threadmanager.h"
+#include "telemetry.h"
 
 struct LocationDetails
 {
@@ -26,12 +29,21 @@ struct LocationDetails
     int column;
 };
 
+/* What the base register of a memory operand tells about its address, decided when the image is loaded */
+enum class StackOperand : UINT8
+{
+    None,
+    Frame,   // [rsp+disp] or [rbp-disp] in a function with a frame pointer
+    RedZone  // [rsp-disp] below the stack pointer
+};
+
 struct MemoryOperationDetails
 {
     ADDRINT address;
     UINT32 size;
     BOOL isRead;
     BOOL isWrite;
+    StackOperand stack;
 };
 
 struct AccessInstructionDetails
@@ -40,23 +52,47 @@ struct AccessInstructionDetails
     int location;
 };
 
+/* Address of a memory operand of a batched instruction, base and index are slots of the registers captured at the
+ * start of the block, -1 for none */
+struct BlockOperand
+{
+    INT32 base;
+    INT32 index;
+    UINT32 scale;
+    ADDRDELTA displacement;
+};
+
+struct BlockInstruction
+{
+    AccessInstructionDetails* details;
+    std::vector<BlockOperand> operands;
+};
+
+/* Memory instructions of a basic block recorded by one BlockAccesses entry, none of them changes the registers a later
+ * one uses */
+struct BlockAccessDetails
+{
+    std::vector<BlockInstruction> instructions;
+    std::vector<REG> registers;
+};
+
 struct ReferenceData {
     ReferenceData() {
         wasAccessed = false;
+        isStack = false;
     }
 
   Reference ref;
   bool wasAccessed;
 
   bool isStack;
-  ADDRDELTA stackDelta;
-  int stackFctAlloc;
 };
 
 class Manager
 {
 public:
-    Manager(const std::string& db, const std::string& source, const std::string& filter);
+    Manager(const std::string& db, const std::string& source, const std::string& filter, const DatabaseOptions& options = DatabaseOptions());
+    ~Manager();
 
     SQLWriter writer;
     Filter filter;
@@ -72,17 +108,29 @@ public:
     std::map<ADDRINT, CallEnterBufferEntry> callAddressesToInstrument;
     std::map<ADDRINT, RetBufferEntry> retAddressesToInstrument;
     std::map<ADDRINT, ADDRINT> callInstructionAddressesToInstrument;
+    std::map<ADDRINT, LoopBufferEntry> loopHeadersToInstrument;
+    std::map<ADDRINT, LoopBufferEntry> loopExitsToInstrument;
+
+    /* Instructions in these ranges get no access instrumentation, the union of the ranges of the loaded images */
+    AddressRanges filteredAddresses;
+    std::map<UINT32, AddressRanges> imageFilteredAddresses;
 
     std::map<int, std::set<ADDRDELTA> > ignoreConflict;
 
     std::map<ADDRINT, ReferenceData> references;
     ReferenceData redZone;
+
+    /* Size of references, published under referencesLock so telemetry observes it without taking the lock */
+    uint64_t referenceCount;
     void lockReferences();
     void unlockReferences();
 
     std::map<ADDRINT, int> accessToInstrument;
     std::vector<AccessInstructionDetails> accessDetails;
 
+    /* Built in Trace, entries keep pointers to them */
+    std::deque<BlockAccessDetails> blockAccessDetails;
+
     std::vector<Tag> tags;
     std::map<int, Tag> tagIdTagMap;
 
@@ -92,6 +140,30 @@ public:
     bool processCallsByDefault;
     bool processAccessesByDefault;
 
+    /* Aggregate calls into a per thread calling context tree instead of one Call row each */
+    bool aggregateCalls;
+
+    /* Aggregate accesses per instruction, reference and segment instead of one Access row each */
+    bool aggregateAccesses;
+
+    /* Write one ConflictSummary row per instance pair, reference and access types instead of one Conflict row each */
+    bool summarizeConflicts;
+
+    /* Track loop executions found by back edges, each one gets a Loop segment */
+    bool detectLoops;
+
+    /* Give every loop iteration its own segment instead of one per loop execution */
+    bool loopIterationSegments;
+
+    /* Writes to the red zone are not instrumented, they never take part in conflicts */
+    bool dropRedZoneWrites;
+
+    /* Memory instructions of a basic block share one entry with the registers their addresses are computed from */
+    bool batchAccesses;
+
+    /* Slowdown of a thread from analysis its accesses may cause before they are sampled, 0 to trace every access */
+    UINT64 slowdownBudget;
+
     void bufferFull(struct BufferEntry*, UINT64, THREADID);
 
     void setUpThreadManager(THREADID);
@@ -99,6 +171,15 @@ public:
 
     void storeAllocation(THREADID tid, AllocData data);
 
+    /* Writes the counters of a stopped thread, they are summed into the totals written at exit */
+    void writeToolStats(int thread, const ToolStats& stats);
+
+    /* Publishes live stats of every thread in a shared page file, see telemetry.h */
+    void publishTelemetry(const std::string& file);
+
+    /* Slot of a thread in the page, NULL if nothing is published for it */
+    TelemetryThread* getTelemetryThread(THREADID tid);
+
     void lock();
     void unlock();
 private:
@@ -112,6 +193,10 @@ private:
 
     std::map<THREADID, ThreadManager> threadmanagers;
 
+    ToolStats toolStats;
+
+    TelemetryPage* telemetry;
+
     PIN_MUTEX mutex;
     PIN_MUTEX knownAllocationsLock;
     PIN_MUTEX referencesLock;
@@ -0,0 +1,144 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "telemetry.h"
+
+/* Prints the telemetry page of a running dynamic tool, only reads the page and never attaches to the process */
+
+struct Sample
+{
+    std::chrono::steady_clock::time_point time;
+    uint64_t rows;
+    std::vector<uint64_t> events;
+};
+
+static const char* stateName(uint64_t state)
+{
+    switch ((TelemetryState)state)
+    {
+    case TelemetryState::Running:
+        return "running";
+    case TelemetryState::Stopped:
+        return "stopped";
+    default:
+        return "unused";
+    }
+}
+
+Sample takeSample(const TelemetryPage* page)
+{
+    Sample sample;
+
+    sample.time = std::chrono::steady_clock::now();
+    sample.rows = observe(&page->header.rows);
+
+    for (uint32_t i = 0; i < page->header.threads; i++)
+        sample.events.push_back(observe(&page->threads[i].events));
+
+    return sample;
+}
+
+void print(const TelemetryPage* page, const Sample& sample, const Sample* previous)
+{
+    double seconds = previous != NULL ? std::chrono::duration<double>(sample.time - previous->time).count() : 0;
+
+    printf("pid %lld, %llu rows", (long long)page->header.pid, (unsigned long long)sample.rows);
+
+    if (seconds > 0)
+        printf(", %.0f rows/s", (sample.rows - previous->rows) / seconds);
+
+    printf("\n%-8s %-8s %14s %12s %10s %8s %6s %12s\n", "thread", "state", "events", "events/s", "buffers", "depth", "tags", "references");
+
+    for (uint32_t i = 0; i < page->header.threads; i++)
+    {
+        const TelemetryThread& thread = page->threads[i];
+        uint64_t state = observe(&thread.state);
+
+        if (state == (uint64_t)TelemetryState::Unused)
+            continue;
+
+        // A slot taken over by a new thread starts again from 0
+        double rate = 0;
+
+        if (seconds > 0 && sample.events[i] >= previous->events[i])
+            rate = (sample.events[i] - previous->events[i]) / seconds;
+
+        printf("%-8llu %-8s %14llu %12.0f %10llu %8llu %6llu %12llu\n",
+               (unsigned long long)observe(&thread.thread), stateName(state), (unsigned long long)sample.events[i], rate,
+               (unsigned long long)observe(&thread.buffers), (unsigned long long)observe(&thread.callDepth),
+               (unsigned long long)observe(&thread.tagInstances), (unsigned long long)observe(&thread.references));
+    }
+
+    printf("\n");
+    fflush(stdout);
+}
+
+int usage()
+{
+    std::cerr << "Usage: pintool_monitor [-i seconds] page" << std::endl;
+    std::cerr << "Prints the page written by pintool_dynamic -telemetry page, every interval until the process exits." << std::endl;
+
+    return -1;
+}
+
+int main(int argc, char* argv[])
+{
+    double interval = 0;
+    std::string file;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+
+        if (arg == "-i" && i + 1 < argc)
+            interval = atof(argv[++i]);
+        else if (arg[0] != '-' && file.empty())
+            file = arg;
+        else
+            return usage();
+    }
+
+    if (file.empty())
+        return usage();
+
+    const TelemetryPage* page = openTelemetryPage(file);
+
+    if (page == NULL)
+    {
+        std::cerr << "Cannot read " << file << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+
+    Sample previous = takeSample(page);
+
+    print(page, previous, NULL);
+
+    while (interval > 0)
+    {
+        std::this_thread::sleep_for(std::chrono::duration<double>(interval));
+
+        bool running = kill(page->header.pid, 0) == 0 || errno != ESRCH;
+
+        Sample sample = takeSample(page);
+
+        print(page, sample, &previous);
+        previous = sample;
+
+        if (!running)
+            break;
+    }
+
+    closeTelemetryPage(page);
+
+    return 0;
+}
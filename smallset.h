@@ -0,0 +1,77 @@
+#ifndef SMALLSET_H
+#define SMALLSET_H
+
+#include <cstddef>
+#include <vector>
+
+/* Unordered set keeping up to N elements inline, larger sets move to the heap */
+template <typename T, std::size_t N>
+class SmallSet
+{
+public:
+    SmallSet() : count(0) {}
+
+    bool contains(const T& value) const
+    {
+        for (const T* it = begin(); it != end(); it++)
+        {
+            if (*it == value)
+                return true;
+        }
+
+        return false;
+    }
+
+    void insert(const T& value)
+    {
+        if (contains(value))
+            return;
+
+        if (count < N)
+        {
+            items[count] = value;
+        }
+        else
+        {
+            if (count == N)
+                overflow.assign(items, items + N);
+
+            overflow.push_back(value);
+        }
+
+        count++;
+    }
+
+    void clear()
+    {
+        overflow.clear();
+        count = 0;
+    }
+
+    std::size_t size() const
+    {
+        return count;
+    }
+
+    bool empty() const
+    {
+        return count == 0;
+    }
+
+    const T* begin() const
+    {
+        return count <= N ? items : overflow.data();
+    }
+
+    const T* end() const
+    {
+        return begin() + count;
+    }
+
+private:
+    std::size_t count;
+    T items[N];
+    std::vector<T> overflow;
+};
+
+#endif // SMALLSET_H
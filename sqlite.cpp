@@ -53,6 +53,11 @@ int Connection::lastInsertedROWID()
     return sqlite3_last_insert_rowid(this->db);
 }
 
+int64_t Connection::totalChanges()
+{
+    return sqlite3_total_changes(this->db);
+}
+
 void Connection::execute(const char *sql)
 {
     lock();
@@ -66,6 +71,65 @@ void Connection::execute(const char *sql)
     unlock();
 }
 
+sqlite3* Connection::openFile(const char* location)
+{
+    sqlite3* file;
+
+    int code;
+    if (code = sqlite3_open_v2(location, &file, SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX | SQLITE_OPEN_CREATE, NULL) != SQLITE_OK)
+        SQLiteException(sqlite3_errmsg(file), code, "openFile");
+
+    return file;
+}
+
+void Connection::loadFrom(const char* location)
+{
+    sqlite3* file = openFile(location);
+
+    copy(file, this->db, -1);
+
+    sqlite3_close(file);
+}
+
+void Connection::saveTo(const char* location, int pagesPerStep)
+{
+    sqlite3* file = openFile(location);
+
+    copy(this->db, file, pagesPerStep);
+
+    sqlite3_close(file);
+}
+
+void Connection::copy(sqlite3* from, sqlite3* to, int pagesPerStep)
+{
+    sqlite3_backup* backup = sqlite3_backup_init(to, "main", from, "main");
+
+    if (backup == NULL)
+        SQLiteException(sqlite3_errmsg(to), sqlite3_errcode(to), "backup init");
+
+    int code;
+
+    do
+    {
+        lock();
+
+        code = sqlite3_backup_step(backup, pagesPerStep);
+
+        // Writers get the connection between steps of an incremental backup
+        unlock();
+    } while (code == SQLITE_OK || code == SQLITE_BUSY || code == SQLITE_LOCKED);
+
+    sqlite3_backup_finish(backup);
+
+    if (code != SQLITE_DONE)
+        SQLiteException(sqlite3_errmsg(to), code, "backup step");
+}
+
+int64_t Connection::memoryUsed()
+{
+    return sqlite3_memory_used();
+}
+
 void Connection::lock()
 {
     PIN_MutexLock(&mutex);
@@ -108,9 +172,7 @@ void Statement::bind(int pos, int64_t val)
     connection->lock();
 
     checkBind(pos);
-
-    if (int code = sqlite3_bind_int64(this->stmt, pos, (sqlite3_int64)val) != SQLITE_OK)
-        SQLiteException(this->connection.get(), code, "bind int64_t");
+    bindUnlocked(pos, val);
 
     connection->unlock();
 }
@@ -120,9 +182,7 @@ void Statement::bind(int pos, int val )
     connection->lock();
 
     checkBind(pos);
-
-    if (int code = sqlite3_bind_int(this->stmt, pos, val) != SQLITE_OK)
-        SQLiteException(this->connection.get(), code, "bind int");
+    bindUnlocked(pos, val);
 
     connection->unlock();
 }
@@ -132,9 +192,7 @@ void Statement::bind(int pos, const std::string& val)
     connection->lock();
 
     checkBind(pos);
-
-    if (int code = sqlite3_bind_text(this->stmt, pos, val.c_str(), -1, SQLITE_TRANSIENT) != SQLITE_OK)
-        SQLiteException(this->connection.get(), code, "bind std::string");
+    bindUnlocked(pos, val);
 
     connection->unlock();
 }
@@ -144,9 +202,7 @@ void Statement::bind(int pos, const char* val)
     connection->lock();
 
     checkBind(pos);
-
-    if (int code = sqlite3_bind_text(this->stmt, pos, val, -1, SQLITE_TRANSIENT) != SQLITE_OK)
-        SQLiteException(this->connection.get(), code, "bind char*");
+    bindUnlocked(pos, val);
 
     connection->unlock();
 }
@@ -170,11 +226,39 @@ void Statement::bindNULL(int pos)
     connection->lock();
 
     checkBind(pos);
+    bindUnlocked(pos, SQLNULL);
+
+    connection->unlock();
+}
+
+void Statement::bindUnlocked(int pos, int64_t val)
+{
+    if (int code = sqlite3_bind_int64(this->stmt, pos, (sqlite3_int64)val) != SQLITE_OK)
+        SQLiteException(this->connection.get(), code, "bind int64_t");
+}
+
+void Statement::bindUnlocked(int pos, int val)
+{
+    if (int code = sqlite3_bind_int(this->stmt, pos, val) != SQLITE_OK)
+        SQLiteException(this->connection.get(), code, "bind int");
+}
 
+void Statement::bindUnlocked(int pos, const std::string& val)
+{
+    if (int code = sqlite3_bind_text(this->stmt, pos, val.c_str(), val.size(), SQLITE_TRANSIENT) != SQLITE_OK)
+        SQLiteException(this->connection.get(), code, "bind std::string");
+}
+
+void Statement::bindUnlocked(int pos, const char* val)
+{
+    if (int code = sqlite3_bind_text(this->stmt, pos, val, -1, SQLITE_TRANSIENT) != SQLITE_OK)
+        SQLiteException(this->connection.get(), code, "bind char*");
+}
+
+void Statement::bindUnlocked(int pos, NullClass)
+{
     if (int code = sqlite3_bind_null(this->stmt, pos) != SQLITE_OK)
         SQLiteException(this->connection.get(), code, "bindNULL");
-
-    connection->unlock();
 }
 
 void Statement::checkBind(int pos)
@@ -208,6 +292,33 @@ int Statement::columnInt(int col)
     return val;
 }
 
+int64_t Statement::columnInt64(int col)
+{
+    checkColumn(col);
+
+    connection->lock();
+
+    int64_t val = sqlite3_column_int64(stmt, col);
+
+    connection->unlock();
+
+    return val;
+}
+
+std::string Statement::columnString(int col)
+{
+    checkColumn(col);
+
+    connection->lock();
+
+    const char* text = (const char*)sqlite3_column_text(stmt, col);
+    std::string val = text ? text : "";
+
+    connection->unlock();
+
+    return val;
+}
+
 void Statement::execute()
 {
     connection->lock();
@@ -6,6 +6,8 @@
 
 #include <pin.H>
 
+#include "exception.h"
+
 struct sqlite3;
 struct sqlite3_stmt;
 
@@ -27,13 +29,25 @@ public:
 
     int lastInsertedROWID();
 
+    /* Rows inserted, updated or deleted since the connection was opened */
+    int64_t totalChanges();
+
     void execute(const char* sql);
 
+    /* Online backup between this connection and a database file */
+    void loadFrom(const char* location);
+    void saveTo(const char* location, int pagesPerStep = -1);
+
+    static int64_t memoryUsed();
+
     void lock();
     void unlock();
 private:
     sqlite3* db;
 
+    static sqlite3* openFile(const char* location);
+    void copy(sqlite3* from, sqlite3* to, int pagesPerStep);
+
     PIN_MUTEX mutex;
 
     friend class Statement;
@@ -42,6 +56,20 @@ private:
 class NullClass {};
 extern NullClass SQLNULL;
 
+/* A value bound as NULL when it is not present */
+template <typename T>
+struct Optional
+{
+    bool present;
+    T value;
+};
+
+template <typename T>
+Optional<T> nullUnless(bool present, const T& value)
+{
+    return Optional<T>{present, value};
+}
+
 class Statement : public std::enable_shared_from_this<Statement>
 {
 public:
@@ -59,10 +87,55 @@ public:
     void bind(int, struct timespec);
     void bindNULL(int);
 
+    /* Binds every parameter under a single connection lock */
+    template <typename... Args>
+    void bindAll(const Args&... args)
+    {
+        connection->lock();
+
+        bindAllUnlocked(args...);
+
+        connection->unlock();
+    }
+
+    /* Binds, steps and resets under a single connection lock, returns the inserted ROWID */
+    template <typename... Args>
+    int insert(const Args&... args)
+    {
+        connection->lock();
+
+        bindAllUnlocked(args...);
+
+        this->stepUnlocked();
+        this->resetUnlocked();
+        this->clearBindingsUnlocked();
+
+        int lastRow = connection->lastInsertedROWID();
+
+        connection->unlock();
+
+        return lastRow;
+    }
+
+    template <typename... Args>
+    void execute(const Args&... args)
+    {
+        connection->lock();
+
+        bindAllUnlocked(args...);
+
+        this->stepUnlocked();
+        this->resetUnlocked();
+        this->clearBindingsUnlocked();
+
+        connection->unlock();
+    }
+
     void checkBind(int);
     void checkColumn(int);
 
     int columnInt(int);
+    int64_t columnInt64(int);
     std::string columnString(int);
 
     template <typename T> T column(int);
@@ -80,7 +153,46 @@ public:
     void stepUnlocked();
 
     bool stepRowUnlocked();
+
+    void bindUnlocked(int pos, uint64_t val)
+    {
+        this->bindUnlocked(pos, (int64_t) val);
+    }
+    void bindUnlocked(int, int64_t);
+    void bindUnlocked(int, int);
+    void bindUnlocked(int, const std::string&);
+    void bindUnlocked(int, const char*);
+    void bindUnlocked(int, NullClass);
+
+    template <typename T>
+    void bindUnlocked(int pos, const Optional<T>& val)
+    {
+        if (val.present)
+            bindUnlocked(pos, val.value);
+        else
+            bindUnlocked(pos, SQLNULL);
+    }
 private:
+    template <typename... Args>
+    void bindAllUnlocked(const Args&... args)
+    {
+        if (sizeof...(Args) != paramCount)
+            SQLiteException("Wrong number of parameters", 0, "bindAll");
+
+        bindNextUnlocked(1, args...);
+
+        lastBound = paramCount;
+    }
+
+    void bindNextUnlocked(int) {}
+
+    template <typename T, typename... Rest>
+    void bindNextUnlocked(int pos, const T& val, const Rest&... rest)
+    {
+        bindUnlocked(pos, val);
+        bindNextUnlocked(pos + 1, rest...);
+    }
+
     sqlite3_stmt* stmt;
     std::shared_ptr<Connection> connection;
     int columnCount;
@@ -92,6 +204,10 @@ template <> inline int Statement::column<int>(int col)
 {
     return columnInt(col);
 }
+template <> inline int64_t Statement::column<int64_t>(int col)
+{
+    return columnInt64(col);
+}
 template <> inline std::string Statement::column<std::string>(int col)
 {
     return columnString(col);
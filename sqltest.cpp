@@ -6,15 +6,179 @@
 #include <memory>
 #include <set>
 
+#include <unistd.h>
+
 #include <pin.H>
 
 #include "sqlwriter.h"
+#include "sqlite.h"
 #include "asm.h"
 
+void benchmarkBinding(std::vector<Call>& calls)
+{
+    unlink("bind.db");
+
+    auto db = std::make_shared<SQLite::Connection>("bind.db");
+
+    db->execute("CREATE TABLE Call(Id INTEGER PRIMARY KEY, Thread INTEGER, Function INTEGER, Instruction INTEGER, Start INTEGER, End INTEGER);");
+    db->execute("BEGIN EXCLUSIVE TRANSACTION");
+
+    std::shared_ptr<SQLite::Statement> stmt = db->makeStatement("INSERT INTO Call(Id, Thread, Function, Instruction, Start, End) VALUES(?, ?, ?, ?, ?, ?);");
+
+    UINT64 startStream = rdtsc();
+
+    for(auto&it : calls) {
+        stmt << it.id << it.thread << it.function << it.instruction << it.start << it.end;
+        stmt->execute();
+    }
+
+    UINT64 endStream = rdtsc();
+
+    db->execute("DELETE FROM Call");
+
+    UINT64 startVariadic = rdtsc();
+
+    for(auto&it : calls) {
+        stmt->execute(it.id, it.thread, it.function, it.instruction, it.start, it.end);
+    }
+
+    UINT64 endVariadic = rdtsc();
+
+    db->execute("COMMIT TRANSACTION");
+
+    std::cout << "operator<< cycles/row: " << (double)(endStream - startStream) / calls.size() << std::endl;
+    std::cout << "execute(...) cycles/row: " << (double)(endVariadic - startVariadic) / calls.size() << std::endl;
+}
+
+int countRows(std::shared_ptr<SQLite::Connection> db, const std::string& table)
+{
+    std::shared_ptr<SQLite::Statement> stmt = db->makeStatement(("SELECT COUNT(*) FROM " + table).c_str());
+
+    return stmt->stepRow() ? stmt->columnInt(0) : -1;
+}
+
+int insertImageFunction(SQLWriter& writer, const std::string& name)
+{
+    Image image;
+    image.name = "reopen.so";
+    image.size = 0;
+    image.modificationTime = 0;
+    writer.insertImage(image);
+
+    File file;
+    file.name = "reopen.c";
+    file.image = image.id;
+    writer.insertFile(file);
+
+    Function function;
+    function.name = name;
+    function.file = file.id;
+    function.line = 1;
+    writer.insertFunction(function);
+
+    return function.id;
+}
+
+/* Rows of dynamic runs pointing at a function that is not in the database */
+int countDangling(std::shared_ptr<SQLite::Connection> db)
+{
+    return countRows(db, "Call WHERE Function NOT IN (SELECT Id FROM Function)") +
+           countRows(db, "Reference WHERE Function NOT IN (SELECT Id FROM Function)");
+}
+
+/* The static tools open an existing database without touching the rows of dynamic runs until an image is reindexed,
+ * the dynamic tool empties them */
+bool checkReopen()
+{
+    unlink("reopen.db");
+
+    {
+        SQLWriter writer("reopen.db", true);
+
+        int function = insertImageFunction(writer, "f");
+
+        Call call;
+        call.genId();
+        call.thread = 1;
+        call.function = function;
+        call.instruction = -1;
+        call.start = 1;
+        call.end = 2;
+
+        writer.insertCall(call);
+
+        Reference reference;
+        reference.genId();
+        reference.size = 8;
+        reference.type = ReferenceType::Stack;
+        reference.allocator = -1;
+        reference.deallocator = -1;
+        reference.address = 0;
+        reference.stackDelta = -8;
+        reference.function = function;
+
+        writer.insertReference(reference);
+
+        Access access;
+        access.instruction = 1;
+        access.reference = reference.id;
+        access.position = 0;
+        access.type = AccessType::Read;
+        access.address = 0x1000;
+        access.size = 8;
+
+        writer.insertAccess(access);
+    }
+
+    DatabaseOptions reindex;
+    reindex.resetDynamicTables = false;
+
+    {
+        SQLWriter writer("reopen.db", false, reindex);
+    }
+
+    bool kept;
+
+    {
+        auto db = std::make_shared<SQLite::Connection>("reopen.db");
+        kept = countRows(db, "Call") == 1 && countRows(db, "Reference") == 1 && countRows(db, "Access") == 1;
+    }
+
+    {
+        SQLWriter writer("reopen.db", false, reindex);
+
+        writer.deleteImage("reopen.so");
+        insertImageFunction(writer, "g");
+    }
+
+    bool consistent;
+
+    {
+        auto db = std::make_shared<SQLite::Connection>("reopen.db");
+        consistent = countRows(db, "Function") == 1 && countRows(db, "Call") == 0 && countDangling(db) == 0;
+    }
+
+    {
+        SQLWriter writer("reopen.db", false);
+    }
+
+    auto db = std::make_shared<SQLite::Connection>("reopen.db");
+    bool emptied = countRows(db, "Call") == 0 && countRows(db, "Access") == 0;
+
+    std::cout << "reindex keeps dynamic tables: " << (kept ? "ok" : "FAILED") << std::endl;
+    std::cout << "changed image resets them: " << (consistent ? "ok" : "FAILED") << std::endl;
+    std::cout << "dynamic run empties them: " << (emptied ? "ok" : "FAILED") << std::endl;
+
+    return kept && consistent && emptied;
+}
+
 int main(int argc, char * argv[])
 {
     PIN_Init(argc, argv);
 
+    if (!checkReopen())
+        return 1;
+
     std::vector<Call> calls;
 
     calls.resize(10000000);
@@ -53,6 +217,8 @@ int main(int argc, char * argv[])
 
     std::cout << diff << std::endl;
 
+    benchmarkBinding(calls);
+
     PIN_StartProgram();
 
     return 0;
@@ -1,19 +1,78 @@
 #include "sqlwriter.h"
 
-#include "exception.h"
+#include <unistd.h>
+
+#include <set>
+#include <vector>
 
-SQLWriter::SQLWriter(const std::string& file, bool createDb) : db(std::make_shared<SQLite::Connection>(file.c_str(), createDb))
+#include "exception.h"
+#include "telemetry.h"
+
+/* Tables written by the dynamic tool, dropped and created again when it opens an existing database */
+static const std::set<std::string> dynamicTables = {
+    "Access",
+    "AccessSampling",
+    "AccessSummary",
+    "Call",
+    "CCTNode",
+    "CallTagInstance",
+    "Conflict",
+    "ConflictSummary",
+    "Instruction",
+    "InstructionTagInstance",
+    "Loop",
+    "LoopExecution",
+    "LoopExecutionSummary",
+    "LoopHeader",
+    "LoopIteration",
+    "LoopIterationSegment",
+    "Member",
+    "Reference",
+    "Segment",
+    "SegmentSampling",
+    "Tag",
+    "TagHit",
+    "TagInstance",
+    "TagInstruction",
+    "Thread",
+    "ToolStats"
+};
+
+DatabaseMode parseDatabaseMode(const std::string& mode)
+{
+    if (mode == "file")
+        return DatabaseMode::File;
+    else if (mode == "memory")
+        return DatabaseMode::Memory;
+
+    SQLWriterException("Unknown database mode " + mode, "parseDatabaseMode");
+
+    return DatabaseMode::File;
+}
+
+SQLWriter::SQLWriter(const std::string& file, bool createDb, const DatabaseOptions& options) : db(openConnection(file, createDb, options)), file(file), options(options)
 {
     PIN_MutexInit(&mutex);
 
+    publishedRows = NULL;
+    dynamicTablesKept = false;
+
     runPragmas();
 
     if (createDb)
     {
         createDatabase();
     }
+    else if (options.resetDynamicTables)
+    {
+        dropDynamicTables();
+    }
+    else
+    {
+        dynamicTablesKept = true;
+    }
 
-    clearDatabase();
+    createAggregateTables();
 
     prepareStatements();
 
@@ -24,6 +83,9 @@ SQLWriter::SQLWriter(std::shared_ptr<SQLite::Connection> db, bool createDb) : db
 {
     PIN_MutexInit(&mutex);
 
+    publishedRows = NULL;
+    dynamicTablesKept = false;
+
     runPragmas();
 
     if (createDb)
@@ -31,6 +93,8 @@ SQLWriter::SQLWriter(std::shared_ptr<SQLite::Connection> db, bool createDb) : db
         createDatabase();
     }
 
+    createAggregateTables();
+
     clearDatabase();
 
     prepareStatements();
@@ -38,12 +102,81 @@ SQLWriter::SQLWriter(std::shared_ptr<SQLite::Connection> db, bool createDb) : db
     begin();
 }
 
+std::shared_ptr<SQLite::Connection> SQLWriter::openConnection(const std::string& file, bool createDb, const DatabaseOptions& options)
+{
+    if (options.mode == DatabaseMode::File)
+        return std::make_shared<SQLite::Connection>(file.c_str(), createDb);
+
+    if (createDb && access(file.c_str(), F_OK) != -1)
+        SQLWriterException("Database already exists", "openConnection");
+
+    std::shared_ptr<SQLite::Connection> connection = std::make_shared<SQLite::Connection>(":memory:");
+
+    if (!createDb)
+        connection->loadFrom(file.c_str());
+
+    return connection;
+}
+
+/* Drops the dynamic tables and creates them again from their schema in one transaction, the static tables are not
+ * touched. Dropping only moves the pages of the previous run to the free list. */
+void SQLWriter::dropDynamicTables()
+{
+    std::vector<std::string> tables;
+    std::vector<std::string> schema;
+
+    std::shared_ptr<SQLite::Statement> schemaStmt = this->db->makeStatement("SELECT type, name, tbl_name, sql FROM sqlite_master WHERE sql IS NOT NULL AND name NOT LIKE 'sqlite_%' ORDER BY type = 'table' DESC, rowid");
+
+    while (schemaStmt->stepRow())
+    {
+        std::string type, name, table, sql;
+
+        schemaStmt >> type >> name >> table >> sql;
+
+        // Views are kept, indexes and triggers go with their table
+        if (type == "view" || dynamicTables.find(table) == dynamicTables.end())
+            continue;
+
+        if (type == "table")
+            tables.push_back(name);
+
+        schema.push_back(sql);
+    }
+
+    schemaStmt->reset();
+
+    // With foreign keys enforced a drop deletes every row first
+    std::shared_ptr<SQLite::Statement> foreignKeysStmt = this->db->makeStatement("PRAGMA foreign_keys");
+    bool foreignKeys = foreignKeysStmt->stepRow() && foreignKeysStmt->columnInt(0) != 0;
+    foreignKeysStmt->reset();
+
+    if (foreignKeys)
+        this->db->execute("PRAGMA foreign_keys = OFF");
+
+    this->db->execute("BEGIN TRANSACTION");
+
+    for (auto& it : tables)
+    {
+        this->db->execute(("DROP TABLE " + it).c_str());
+    }
+
+    for (auto& it : schema)
+    {
+        this->db->execute(it.c_str());
+    }
+
+    this->db->execute("COMMIT TRANSACTION");
+
+    if (foreignKeys)
+        this->db->execute("PRAGMA foreign_keys = ON");
+}
+
 void SQLWriter::prepareStatements()
 {
     beginTransactionStmt = this->db->makeStatement("BEGIN EXCLUSIVE TRANSACTION");
     commitTransactionStmt = this->db->makeStatement("COMMIT TRANSACTION");
 
-    insertImageStmt = this->db->makeStatement("INSERT INTO Image(Name) VALUES(?);");
+    insertImageStmt = this->db->makeStatement("INSERT INTO Image(Name, BuildId, Size, ModificationTime) VALUES(?, ?, ?, ?);");
     insertFileStmt = this->db->makeStatement("INSERT INTO File(Path, Image) VALUES(?, ?);");
     insertFunctionStmt = this->db->makeStatement("INSERT INTO Function(Name, Prototype, File, Line) VALUES(?, ?, ?, ?);");
     insertSourceLocationStmt = this->db->makeStatement("INSERT INTO SourceLocation(Function, Line, Column) VALUES(?, ?, ?);");
@@ -52,22 +185,35 @@ void SQLWriter::prepareStatements()
     insertTagInstanceStmt = this->db->makeStatement("INSERT INTO TagInstance(Id, Tag, Start, End, Thread, Counter) VALUES(?, ?, ?, ?, ?, ?);");
     insertThreadStmt = this->db->makeStatement("INSERT INTO Thread(Id, CreateInstruction, JoinInstruction, Process, StartTime, EndTSC, EndTime) VALUES(?, ?, ?, ?, ?, ?, ?);");
     insertCallStmt = this->db->makeStatement("INSERT INTO Call(Id, Thread, Function, Instruction, Start, End) VALUES(?, ?, ?, ?, ?, ?);");
+    insertCCTNodeStmt = this->db->makeStatement("INSERT INTO CCTNode(Id, Parent, Thread, Function, Segment, CallLine, CallColumn, Count, Inclusive, Exclusive, MinDuration, MaxDuration) VALUES(?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);");
+    insertLoopHeaderStmt = this->db->makeStatement("INSERT INTO LoopHeader(Function, Line, Column) VALUES(?, ?, ?);");
+    insertLoopExecutionSummaryStmt = this->db->makeStatement("INSERT INTO LoopExecutionSummary(Id, Loop, Thread, Segment, Start, End, Iterations, MinIteration, MaxIteration, Dependencies, MinDistance) VALUES(?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);");
+    insertLoopIterationSegmentStmt = this->db->makeStatement("INSERT INTO LoopIterationSegment(Execution, Iteration, Segment, Start, End) VALUES(?, ?, ?, ?, ?);");
+    insertAccessSamplingStmt = this->db->makeStatement("INSERT INTO AccessSampling(Period, Burst, SlowdownBudget) VALUES(?, ?, ?);");
+    insertSegmentSamplingStmt = this->db->makeStatement("INSERT INTO SegmentSampling(Segment, Accesses, Sampled) VALUES(?, ?, ?);");
     insertInstructionStmt = this->db->makeStatement("INSERT INTO Instruction(Segment, Type, Line) VALUES(?, ?, ?);");
     insertSegmentStmt = this->db->makeStatement("INSERT INTO Segment(Call, Type) VALUES(?, ?);");
     insertInstructionTagInstanceStmt = this->db->makeStatement("INSERT INTO InstructionTagInstance(Instruction, TagInstance) VALUES(?, ?);");
     insertCallTagInstanceStmt = this->db->makeStatement("INSERT INTO CallTagInstance(Call, TagInstance) VALUES(?, ?);");
     insertAccessStmt = this->db->makeStatement("INSERT INTO Access(Instruction, Position, Address, Size, Type, Reference) VALUES(?, ?, ?, ?, ?, ?);");
-    insertReferenceStmt = this->db->makeStatement("INSERT INTO Reference(Id, Name, Size, Allocator, Deallocator, Type) VALUES(?, ?, ?, ?, ?, ?);");
+    insertAccessSummaryStmt = this->db->makeStatement("INSERT INTO AccessSummary(Id, Instruction, Reference, Reads, Writes, ReadBytes, WriteBytes, FirstTSC, LastTSC) VALUES(?, ?, ?, ?, ?, ?, ?, ?, ?);");
+    insertReferenceStmt = this->db->makeStatement("INSERT INTO Reference(Id, Name, Size, Allocator, Deallocator, Type, Address, StackDelta, Function) VALUES(?, ?, ?, ?, ?, ?, ?, ?, ?);");
     insertConflictStmt = this->db->makeStatement("INSERT INTO Conflict(TagInstance1, TagInstance2, Access1, Access2) VALUES(?, ?, ?, ?)");
+    insertConflictSummaryStmt = this->db->makeStatement("INSERT INTO ConflictSummary(TagInstance1, TagInstance2, Reference, Type1, Type2, Count, FirstAccess1, FirstAccess2, LastAccess1, LastAccess2, LowAddress, HighAddress) VALUES(?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
 
     insertTagHitStmt = this->db->makeStatement("INSERT INTO TagHit(TSC, TagInstruction, Thread) VALUES(?, ?, ?);");
+    insertToolStatStmt = this->db->makeStatement("INSERT INTO ToolStats(Thread, Name, Calls, Cycles) VALUES(?, ?, ?, ?);");
 
     getFunctionIdByPropertiesStmt = this->db->makeStatement("SELECT Id FROM Function WHERE Prototype = ? AND File = (SELECT Id FROM File WHERE Image = ? AND Path = ?) AND Line = ?");
     getSourceLocationIdStmt = this->db->makeStatement("SELECT Id FROM SourceLocation WHERE Function = ? AND Line = ? AND Column = ?");
     getSourceLocationByIdStmt = this->db->makeStatement("SELECT Function, Line, Column FROM SourceLocation WHERE Id = ?");
     getImageIdByNameStmt = this->db->makeStatement("SELECT Id FROM Image WHERE Name = ?");
+    getImagesStmt = this->db->makeStatement("SELECT Id, Name, BuildId, Size, ModificationTime FROM Image");
 
-    functionExistsStmt = this->db->makeStatement("SELECT Id FROM Function WHERE Name = ? AND Prototype = ? AND File = ? AND Line = ?");
+    deleteImageSourceLocationsStmt = this->db->makeStatement("DELETE FROM SourceLocation WHERE Function IN (SELECT Function.Id FROM Function JOIN File ON Function.File = File.Id JOIN Image ON File.Image = Image.Id WHERE Image.Name = ?)");
+    deleteImageFunctionsStmt = this->db->makeStatement("DELETE FROM Function WHERE File IN (SELECT File.Id FROM File JOIN Image ON File.Image = Image.Id WHERE Image.Name = ?)");
+    deleteImageFilesStmt = this->db->makeStatement("DELETE FROM File WHERE Image IN (SELECT Id FROM Image WHERE Name = ?)");
+    deleteImageStmt = this->db->makeStatement("DELETE FROM Image WHERE Name = ?");
 }
 
 
@@ -75,6 +221,9 @@ SQLWriter::~SQLWriter()
 {
     commit();
 
+    if (options.mode == DatabaseMode::Memory)
+        db->saveTo(file.c_str(), options.backupPagesPerStep);
+
     PIN_MutexFini(&mutex);
 }
 
@@ -88,6 +237,42 @@ void SQLWriter::commit()
     commitTransactionStmt->execute();
 }
 
+void SQLWriter::checkMemoryLimit()
+{
+    if (options.mode != DatabaseMode::Memory || options.memoryLimit == 0)
+        return;
+
+    if ((UINT64)SQLite::Connection::memoryUsed() < options.memoryLimit)
+        return;
+
+    lock();
+
+    // Another thread may have spilled while we waited for the lock
+    if (options.mode == DatabaseMode::Memory)
+        spillToDisk();
+
+    unlock();
+}
+
+void SQLWriter::spillToDisk()
+{
+    Warn("SQLWriter", "In-memory database reached its limit, continuing in " + file);
+
+    commit();
+
+    db->saveTo(file.c_str(), options.backupPagesPerStep);
+
+    // Replacing the statements releases the last references to the in-memory connection
+    db = std::make_shared<SQLite::Connection>(file.c_str());
+
+    runPragmas();
+    prepareStatements();
+
+    options.mode = DatabaseMode::File;
+
+    begin();
+}
+
 void SQLWriter::createDatabase()
 {
     this->db->execute(
@@ -95,6 +280,48 @@ void SQLWriter::createDatabase()
     );
 }
 
+void SQLWriter::createAggregateTables()
+{
+    addMissingColumns("Image", {
+        {"BuildId", "TEXT"},
+        {"Size", "INTEGER"},
+        {"ModificationTime", "INTEGER"}
+    });
+
+    addMissingColumns("Reference", {
+        {"Address", "INTEGER"},
+        {"StackDelta", "INTEGER"},
+        {"Function", "INTEGER REFERENCES Function(Id)"}
+    });
+
+    this->db->execute(
+#include "aggregate.sql.h"
+    );
+}
+
+/* Extends a table of the shared schema with the columns written by this tool */
+void SQLWriter::addMissingColumns(const std::string& table, const std::vector<std::pair<std::string, std::string> >& columns)
+{
+    std::set<std::string> existing;
+
+    {
+        std::shared_ptr<SQLite::Statement> tableInfoStmt = this->db->makeStatement(("PRAGMA table_info(" + table + ")").c_str());
+
+        while (tableInfoStmt->stepRow())
+        {
+            existing.insert(tableInfoStmt->columnString(1));
+        }
+
+        tableInfoStmt->reset();
+    }
+
+    for (auto& it : columns)
+    {
+        if (existing.find(it.first) == existing.end())
+            this->db->execute(("ALTER TABLE " + table + " ADD COLUMN " + it.first + " " + it.second).c_str());
+    }
+}
+
 void SQLWriter::runPragmas()
 {
     this->db->execute(
@@ -116,81 +343,103 @@ void SQLWriter::lock()
 
 void SQLWriter::unlock()
 {
+    if (publishedRows != NULL)
+        publish(publishedRows, db->totalChanges());
+
     PIN_MutexUnlock(&mutex);
 }
 
+void SQLWriter::publishRows(std::uint64_t* counter)
+{
+    lock();
+    publishedRows = counter;
+    unlock();
+}
+
 void SQLWriter::insertImage(Image &image)
 {
+    TOOL_STAT_SHARED_TIMER(toolStats, InsertImage);
+
     lock();
 
-    insertImageStmt << image.name;
-    image.id = insertImageStmt->executeInsert();
+    image.id = insertImageStmt->insert(image.name,
+                                       SQLite::nullUnless(!image.buildId.empty(), image.buildId),
+                                       (int64_t)image.size,
+                                       (int64_t)image.modificationTime);
 
     unlock();
 }
 
 void SQLWriter::insertFile(File &file)
 {
+    TOOL_STAT_SHARED_TIMER(toolStats, InsertFile);
+
     lock();
 
-    insertFileStmt << file.name << file.image;
-    file.id = insertFileStmt->executeInsert();
+    file.id = insertFileStmt->insert(file.name, file.image);
 
     unlock();
 }
 
 void SQLWriter::insertFunction(Function &function)
 {
+    TOOL_STAT_SHARED_TIMER(toolStats, InsertFunction);
+
     lock();
 
-    insertFunctionStmt << function.name << function.prototype << function.file << function.line;
-    function.id = insertFunctionStmt->executeInsert();
+    function.id = insertFunctionStmt->insert(function.name, function.prototype, function.file, function.line);
 
     unlock();
 }
 
 void SQLWriter::insertSourceLocation(SourceLocation &location)
 {
+    TOOL_STAT_SHARED_TIMER(toolStats, InsertSourceLocation);
+
     lock();
 
-    insertSourceLocationStmt << location.function << location.line << location.column;
-    location.id = insertSourceLocationStmt->executeInsert();
+    location.id = insertSourceLocationStmt->insert(location.function, location.line, location.column);
 
     unlock();
 }
 
 void SQLWriter::insertTag(Tag &tag)
 {
+    TOOL_STAT_SHARED_TIMER(toolStats, InsertTag);
+
     lock();
 
-    insertTagStmt << tag.id << tag.name << static_cast<int>(tag.type);
-    tag.id = insertTagStmt->executeInsert();
+    tag.id = insertTagStmt->insert(tag.id, tag.name, static_cast<int>(tag.type));
 
     unlock();
 }
 
 void SQLWriter::insertTagInstruction(TagInstruction &tagInstruction)
 {
+    TOOL_STAT_SHARED_TIMER(toolStats, InsertTagInstruction);
+
     lock();
 
-    insertTagInstructionStmt << tagInstruction.tag << tagInstruction.location << static_cast<int>(tagInstruction.type);
-    tagInstruction.id = insertTagInstructionStmt->executeInsert();
+    tagInstruction.id = insertTagInstructionStmt->insert(tagInstruction.tag, tagInstruction.location, static_cast<int>(tagInstruction.type));
 
     unlock();
 }
 
 void SQLWriter::insertTagInstance(const TagInstance &tagInstance)
 {
+    TOOL_STAT_SHARED_TIMER(toolStats, InsertTagInstance);
+
     lock();
 
-    insertTagInstanceStmt << tagInstance.id << tagInstance.tag << tagInstance.start << tagInstance.end << tagInstance.thread << tagInstance.counter;
-    insertTagInstanceStmt->execute();
+    insertTagInstanceStmt->execute(tagInstance.id, tagInstance.tag, tagInstance.start, tagInstance.end, tagInstance.thread, tagInstance.counter);
 
     unlock();
 }
 
 void SQLWriter::insertThread(const Thread &thread )
 {
+    TOOL_STAT_SHARED_TIMER(toolStats, InsertThread);
+
     lock();
 
     insertThreadStmt << thread.id << thread.createInstruction << thread.joinInstruction << thread.process << thread.startTime << thread.endTSC << thread.endTime;
@@ -201,107 +450,230 @@ void SQLWriter::insertThread(const Thread &thread )
 
 void SQLWriter::insertCall(const Call & call)
 {
+    TOOL_STAT_SHARED_TIMER(toolStats, InsertCall);
+
     lock();
 
     if (call.instruction >= 0)
-        insertCallStmt << call.id << call.thread << call.function << call.instruction << call.start << call.end;
+        insertCallStmt->execute(call.id, call.thread, call.function, call.instruction, call.start, call.end);
+    else
+        insertCallStmt->execute(call.id, call.thread, call.function, SQLite::SQLNULL, call.start, call.end);
+
+    unlock();
+}
+
+void SQLWriter::insertCCTNode(const CCTNode &node)
+{
+    TOOL_STAT_SHARED_TIMER(toolStats, InsertCCTNode);
+
+    lock();
+
+    if (node.parent >= 0)
+        insertCCTNodeStmt->execute(node.id, node.parent, node.thread, node.function, node.segment, node.callLine, node.callColumn, node.count, node.inclusive, node.exclusive, node.minDuration, node.maxDuration);
     else
-        insertCallStmt << call.id << call.thread << call.function << SQLite::SQLNULL << call.start << call.end;
-    insertCallStmt->execute();
+        insertCCTNodeStmt->execute(node.id, SQLite::SQLNULL, node.thread, node.function, node.segment, SQLite::SQLNULL, SQLite::SQLNULL, node.count, node.inclusive, node.exclusive, node.minDuration, node.maxDuration);
 
     unlock();
 }
 
 void SQLWriter::insertSegment(Segment &segment)
 {
+    TOOL_STAT_SHARED_TIMER(toolStats, InsertSegment);
+
+    lock();
+
+    if (segment.call >= 0)
+        segment.id = insertSegmentStmt->insert(segment.call, static_cast<int>(segment.type));
+    else
+        segment.id = insertSegmentStmt->insert(SQLite::SQLNULL, static_cast<int>(segment.type));
+
+    unlock();
+}
+
+void SQLWriter::insertLoopHeader(LoopHeader &loop)
+{
+    TOOL_STAT_SHARED_TIMER(toolStats, InsertLoopHeader);
+
     lock();
 
-    insertSegmentStmt << segment.call << static_cast<int>(segment.type);
-    segment.id = insertSegmentStmt->executeInsert();
+    loop.id = insertLoopHeaderStmt->insert(loop.function, loop.line, loop.column);
+
+    unlock();
+}
+
+void SQLWriter::insertLoopExecutionSummary(const LoopExecutionSummary &execution)
+{
+    TOOL_STAT_SHARED_TIMER(toolStats, InsertLoopExecutionSummary);
+
+    lock();
+
+    if (execution.minDistance >= 0)
+        insertLoopExecutionSummaryStmt->execute(execution.id, execution.loop, execution.thread, execution.segment, execution.start, execution.end,
+                                                execution.iterations, execution.minIteration, execution.maxIteration, execution.dependencies, execution.minDistance);
+    else
+        insertLoopExecutionSummaryStmt->execute(execution.id, execution.loop, execution.thread, execution.segment, execution.start, execution.end,
+                                                execution.iterations, execution.minIteration, execution.maxIteration, execution.dependencies, SQLite::SQLNULL);
+
+    unlock();
+}
+
+void SQLWriter::insertLoopIterationSegment(const LoopIterationSegment &iteration)
+{
+    TOOL_STAT_SHARED_TIMER(toolStats, InsertLoopIterationSegment);
+
+    lock();
+
+    insertLoopIterationSegmentStmt->execute(iteration.execution, iteration.iteration, iteration.segment, iteration.start, iteration.end);
+
+    unlock();
+}
+
+void SQLWriter::insertAccessSampling(const AccessSampling &sampling)
+{
+    TOOL_STAT_SHARED_TIMER(toolStats, InsertAccessSampling);
+
+    lock();
+
+    insertAccessSamplingStmt->execute(sampling.period, sampling.burst, sampling.slowdownBudget);
+
+    unlock();
+}
+
+void SQLWriter::insertSegmentSampling(const SegmentSampling &sampling)
+{
+    TOOL_STAT_SHARED_TIMER(toolStats, InsertSegmentSampling);
+
+    lock();
+
+    insertSegmentSamplingStmt->execute(sampling.segment, sampling.accesses, sampling.sampled);
 
     unlock();
 }
 
 void SQLWriter::insertInstruction(Instruction & instruction)
 {
+    TOOL_STAT_SHARED_TIMER(toolStats, InsertInstruction);
+
     lock();
 
-    insertInstructionStmt << instruction.segment << static_cast<int>(instruction.type) << instruction.line;
-    instruction.id = insertInstructionStmt->executeInsert();
+    instruction.id = insertInstructionStmt->insert(instruction.segment, static_cast<int>(instruction.type), instruction.line);
 
     unlock();
 }
 
 void SQLWriter::insertCallTagInstance(CallTagInstance &callTagInstance)
 {
+    TOOL_STAT_SHARED_TIMER(toolStats, InsertCallTagInstance);
+
     lock();
 
-    insertCallTagInstanceStmt << callTagInstance.call << callTagInstance.tagInstance;
-    callTagInstance.id = insertCallTagInstanceStmt->executeInsert();
+    callTagInstance.id = insertCallTagInstanceStmt->insert(callTagInstance.call, callTagInstance.tagInstance);
 
     unlock();
 }
 
 void SQLWriter::insertInstructionTagInstance(InstructionTagInstance &instructionTagInstance)
 {
+    TOOL_STAT_SHARED_TIMER(toolStats, InsertInstructionTagInstance);
+
     lock();
 
-    insertInstructionTagInstanceStmt << instructionTagInstance.instruction << instructionTagInstance.tagInstance;
-    instructionTagInstance.id = insertInstructionTagInstanceStmt->executeInsert();
+    instructionTagInstance.id = insertInstructionTagInstanceStmt->insert(instructionTagInstance.instruction, instructionTagInstance.tagInstance);
 
     unlock();
 }
 
 void SQLWriter::insertAccess(Access & access)
 {
+    TOOL_STAT_SHARED_TIMER(toolStats, InsertAccess);
+
     lock();
 
-    insertAccessStmt << access.instruction << access.position << access.address << access.size << static_cast<int>(access.type) << access.reference;
-    access.id = insertAccessStmt->executeInsert();
+    access.id = insertAccessStmt->insert(access.instruction, access.position, access.address, access.size, static_cast<int>(access.type), access.reference);
 
     unlock();
 }
 
-void SQLWriter::insertReference(const Reference &reference)
+void SQLWriter::insertAccessSummary(const AccessSummary &summary)
 {
+    TOOL_STAT_SHARED_TIMER(toolStats, InsertAccessSummary);
+
     lock();
 
-    if (reference.allocator > 0) {
-        if (reference.deallocator > 0) {
-            insertReferenceStmt << reference.id << reference.name << reference.size << reference.allocator << reference.deallocator << static_cast<int>(reference.type);
-        } else {
-            insertReferenceStmt << reference.id << reference.name << reference.size << reference.allocator << SQLite::SQLNULL << static_cast<int>(reference.type);
-        }
+    insertAccessSummaryStmt->execute(summary.id, summary.instruction, summary.reference, summary.reads, summary.writes, summary.readBytes, summary.writeBytes, summary.firstTSC, summary.lastTSC);
 
-    } else {
-        if (reference.deallocator > 0) {
-            insertReferenceStmt << reference.id << reference.name << reference.size << SQLite::SQLNULL << reference.deallocator << static_cast<int>(reference.type);
-        } else {
-            insertReferenceStmt << reference.id << reference.name << reference.size << SQLite::SQLNULL << SQLite::SQLNULL << static_cast<int>(reference.type);
-        }
-    }
+    unlock();
+}
+
+void SQLWriter::insertReference(const Reference &reference)
+{
+    TOOL_STAT_SHARED_TIMER(toolStats, InsertReference);
+
+    lock();
+
+    bool isStack = reference.type == ReferenceType::Stack || reference.type == ReferenceType::Parameter;
 
-    insertReferenceStmt->execute();
+    insertReferenceStmt->execute(reference.id,
+                                 SQLite::nullUnless(!reference.name.empty(), reference.name),
+                                 reference.size,
+                                 SQLite::nullUnless(reference.allocator > 0, reference.allocator),
+                                 SQLite::nullUnless(reference.deallocator > 0, reference.deallocator),
+                                 static_cast<int>(reference.type),
+                                 SQLite::nullUnless(reference.type != ReferenceType::RedZone, (uint64_t)reference.address),
+                                 SQLite::nullUnless(isStack, (int64_t)reference.stackDelta),
+                                 SQLite::nullUnless(reference.function >= 0, reference.function));
 
     unlock();
 }
 
 void SQLWriter::insertConflict(Conflict & conflict)
 {
+    TOOL_STAT_SHARED_TIMER(toolStats, InsertConflict);
+
     lock();
 
-    insertConflictStmt << conflict.tagInstance1 << conflict.tagInstance2 << conflict.access1 << conflict.access2;
-    conflict.id = insertConflictStmt->executeInsert();
+    conflict.id = insertConflictStmt->insert(conflict.tagInstance1, conflict.tagInstance2, conflict.access1, conflict.access2);
+
+    unlock();
+}
+
+void SQLWriter::insertConflictSummary(ConflictSummary &summary)
+{
+    TOOL_STAT_SHARED_TIMER(toolStats, InsertConflictSummary);
+
+    lock();
+
+    summary.id = insertConflictSummaryStmt->insert(summary.tagInstance1, summary.tagInstance2, summary.reference, static_cast<int>(summary.type1), static_cast<int>(summary.type2), summary.count,
+                                                   summary.firstAccess1, summary.firstAccess2, summary.lastAccess1, summary.lastAccess2, summary.lowAddress, summary.highAddress);
 
     unlock();
 }
 
 void SQLWriter::insertTagHit(UINT64 tsc, int tagId, int thread)
 {
+    TOOL_STAT_SHARED_TIMER(toolStats, InsertTagHit);
+
     lock();
 
-    insertTagHitStmt << tsc << tagId << thread;
-    insertTagHitStmt->execute();
+    insertTagHitStmt->execute(tsc, tagId, thread);
+
+    unlock();
+}
+
+void SQLWriter::insertToolStats(int thread, const ToolStats& stats)
+{
+    lock();
+
+    for (int i = 0; i < (int)ToolStat::Count; i++)
+    {
+        if (stats.calls[i] == 0)
+            continue;
+
+        insertToolStatStmt->execute(SQLite::nullUnless(thread >= 0, thread),
+                                    std::string(toolStatName((ToolStat)i)),
+                                    stats.calls[i],
+                                    stats.cycles[i]);
+    }
 
     unlock();
 }
@@ -312,7 +684,7 @@ int SQLWriter::getFunctionIdByProperties(const string &name, int image, const st
 
     int Id;
 
-    getFunctionIdByPropertiesStmt << name << image << file << line;
+    getFunctionIdByPropertiesStmt->bindAll(name, image, file, line);
     if (getFunctionIdByPropertiesStmt->stepRow())
     {
         Id = getFunctionIdByPropertiesStmt->column<int>(0);
@@ -344,7 +716,7 @@ int SQLWriter::getSourceLocationId(const SourceLocation &location)
 
     int Id;
 
-    getSourceLocationIdStmt << location.function << location.line << location.column;
+    getSourceLocationIdStmt->bindAll(location.function, location.line, location.column);
     if (getSourceLocationIdStmt->stepRow())
     {
         Id = getSourceLocationIdStmt->columnInt(0);
@@ -373,7 +745,7 @@ int SQLWriter::getImageIdByName(const string &name)
 
     int Id;
 
-    getImageIdByNameStmt << name;
+    getImageIdByNameStmt->bindAll(name);
     if (getImageIdByNameStmt->stepRow())
     {
         Id = getImageIdByNameStmt->columnInt(0);
@@ -396,28 +768,53 @@ int SQLWriter::getImageIdByName(const string &name)
     return Id;
 }
 
-int SQLWriter::functionExists(const Function & fct)
+std::vector<Image> SQLWriter::getImages()
 {
     lock();
 
-    int Id;
+    std::vector<Image> images;
 
-    functionExistsStmt << fct.name << fct.prototype << fct.file << fct.line;
-    if (functionExistsStmt->stepRow())
+    while (getImagesStmt->stepRow())
     {
-        Id = functionExistsStmt->columnInt(0);
+        Image image;
+
+        image.id = getImagesStmt->columnInt(0);
+        image.name = getImagesStmt->columnString(1);
+        image.buildId = getImagesStmt->columnString(2);
+        image.size = getImagesStmt->column<int64_t>(3);
+        image.modificationTime = getImagesStmt->column<int64_t>(4);
+
+        images.push_back(image);
     }
-    else
+
+    getImagesStmt->reset();
+
+    unlock();
+
+    return images;
+}
+
+/* Removes every row of the images with this name, source locations first so the joins still find them. The rows of
+ * dynamic runs point at the deleted functions, so the dynamic tables kept on open are reset before the first delete. */
+void SQLWriter::deleteImage(const std::string& name)
+{
+    lock();
+
+    if (dynamicTablesKept)
     {
-        Id = -1;
+        commit();
+        dropDynamicTables();
+        begin();
+
+        dynamicTablesKept = false;
     }
 
-    functionExistsStmt->reset();
-    functionExistsStmt->clearBindings();
+    deleteImageSourceLocationsStmt->execute(name);
+    deleteImageFunctionsStmt->execute(name);
+    deleteImageFilesStmt->execute(name);
+    deleteImageStmt->execute(name);
 
     unlock();
-
-    return Id;
 }
 
 void SQLWriter::setSourceLocationId(SourceLocation &location)
@@ -432,7 +829,7 @@ SourceLocation SQLWriter::getSourceLocationById(int id)
 
     lock();
 
-    getSourceLocationByIdStmt << location.id;
+    getSourceLocationByIdStmt->bindAll(location.id);
     if (getSourceLocationByIdStmt->stepRow())
     {
         getSourceLocationByIdStmt >> location.function >> location.line >> location.column;
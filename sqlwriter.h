@@ -3,23 +3,52 @@
 
 #include <string>
 #include <memory>
+#include <vector>
 #include <cstdint>
 
 #include <pin.H>
 
 #include "sqlite.h"
+#include "stats.h"
 #include "entities.h"
 
+enum class DatabaseMode
+{
+    File,
+    Memory
+};
+
+DatabaseMode parseDatabaseMode(const std::string& mode);
+
+struct DatabaseOptions
+{
+    DatabaseOptions() : mode(DatabaseMode::File), memoryLimit(0), backupPagesPerStep(-1), resetDynamicTables(true) {}
+
+    DatabaseMode mode;
+
+    /* Bytes held by SQLite before an in-memory database is spilled to disk, 0 for no limit */
+    UINT64 memoryLimit;
+
+    /* Pages copied per backup step, -1 copies everything in one step */
+    int backupPagesPerStep;
+
+    /* Dynamic tables of an existing database are emptied for a new run, the static tools keep them until an image is
+     * reindexed */
+    bool resetDynamicTables;
+};
+
 class SQLWriter
 {
 public:
-    SQLWriter(const std::string& file, bool createDb = false);
+    SQLWriter(const std::string& file, bool createDb = false, const DatabaseOptions& options = DatabaseOptions());
     SQLWriter(std::shared_ptr<SQLite::Connection> db, bool createDb = false);
     ~SQLWriter();
 
     void begin();
     void commit();
 
+    void checkMemoryLimit();
+
     void insertFile(File&);
     void insertImage(Image&);
     void insertFunction(Function&);
@@ -29,21 +58,40 @@ public:
     void insertTagInstance(const TagInstance&);
     void insertThread(const Thread&);
     void insertCall(const Call&);
+    void insertCCTNode(const CCTNode&);
     void insertSegment(Segment&);
+    void insertLoopHeader(LoopHeader&);
+    void insertLoopExecutionSummary(const LoopExecutionSummary&);
+    void insertLoopIterationSegment(const LoopIterationSegment&);
+    void insertAccessSampling(const AccessSampling&);
+    void insertSegmentSampling(const SegmentSampling&);
     void insertInstruction(Instruction&);
     void insertInstructionTagInstance(InstructionTagInstance&);
     void insertCallTagInstance(CallTagInstance&);
     void insertAccess(Access&);
+    void insertAccessSummary(const AccessSummary&);
     void insertReference(const Reference&);
     void insertConflict(Conflict&);
+    void insertConflictSummary(ConflictSummary&);
 
     void insertTagHit(UINT64 tsc, int tagId, int thread);
 
+    /* One row per used counter, thread -1 for the totals of the run */
+    void insertToolStats(int thread, const ToolStats& stats);
+
+    /* Time spent in the insert methods, summed over all threads */
+    ToolStats toolStats;
+
+    /* Stores the rows written so far to counter whenever the writer is unlocked, NULL to stop */
+    void publishRows(std::uint64_t* counter);
+
     int getFunctionIdByProperties(const std::string& name, int image, const std::string& file, int line);
     int getSourceLocationId(const SourceLocation& location);
     int getImageIdByName(const std::string& name);
 
-    int functionExists(const Function&);
+    /* Indexed images with their fingerprints, an image whose file changed is deleted and inserted again */
+    std::vector<Image> getImages();
+    void deleteImage(const std::string& name);
 
     void setSourceLocationId(SourceLocation& location);
 
@@ -51,8 +99,20 @@ public:
 private:
     std::shared_ptr<SQLite::Connection> db;
 
+    std::string file;
+    DatabaseOptions options;
+
+    static std::shared_ptr<SQLite::Connection> openConnection(const std::string& file, bool createDb, const DatabaseOptions& options);
+    void dropDynamicTables();
+    void spillToDisk();
+
     PIN_MUTEX mutex;
 
+    std::uint64_t* publishedRows;
+
+    /* Opened without resetting the dynamic tables and no image deleted yet */
+    bool dynamicTablesKept;
+
     std::shared_ptr<SQLite::Statement> insertSourceLocationStmt;
     std::shared_ptr<SQLite::Statement> insertFileStmt;
     std::shared_ptr<SQLite::Statement> insertImageStmt;
@@ -63,27 +123,42 @@ private:
     std::shared_ptr<SQLite::Statement> insertCallTagInstanceStmt;
     std::shared_ptr<SQLite::Statement> insertThreadStmt;
     std::shared_ptr<SQLite::Statement> insertCallStmt;
+    std::shared_ptr<SQLite::Statement> insertCCTNodeStmt;
     std::shared_ptr<SQLite::Statement> insertSegmentStmt;
+    std::shared_ptr<SQLite::Statement> insertLoopHeaderStmt;
+    std::shared_ptr<SQLite::Statement> insertLoopExecutionSummaryStmt;
+    std::shared_ptr<SQLite::Statement> insertLoopIterationSegmentStmt;
+    std::shared_ptr<SQLite::Statement> insertAccessSamplingStmt;
+    std::shared_ptr<SQLite::Statement> insertSegmentSamplingStmt;
     std::shared_ptr<SQLite::Statement> insertInstructionStmt;
     std::shared_ptr<SQLite::Statement> insertInstructionTagInstanceStmt;
     std::shared_ptr<SQLite::Statement> insertAccessStmt;
+    std::shared_ptr<SQLite::Statement> insertAccessSummaryStmt;
     std::shared_ptr<SQLite::Statement> insertReferenceStmt;
     std::shared_ptr<SQLite::Statement> insertConflictStmt;
+    std::shared_ptr<SQLite::Statement> insertConflictSummaryStmt;
 
     std::shared_ptr<SQLite::Statement> insertTagHitStmt;
+    std::shared_ptr<SQLite::Statement> insertToolStatStmt;
 
     std::shared_ptr<SQLite::Statement> getFunctionIdByPropertiesStmt;
     std::shared_ptr<SQLite::Statement> getSourceLocationIdStmt;
     std::shared_ptr<SQLite::Statement> getSourceLocationByIdStmt;
     std::shared_ptr<SQLite::Statement> getImageIdByNameStmt;
+    std::shared_ptr<SQLite::Statement> getImagesStmt;
 
-    std::shared_ptr<SQLite::Statement> functionExistsStmt;
+    std::shared_ptr<SQLite::Statement> deleteImageSourceLocationsStmt;
+    std::shared_ptr<SQLite::Statement> deleteImageFunctionsStmt;
+    std::shared_ptr<SQLite::Statement> deleteImageFilesStmt;
+    std::shared_ptr<SQLite::Statement> deleteImageStmt;
 
     std::shared_ptr<SQLite::Statement> beginTransactionStmt;
     std::shared_ptr<SQLite::Statement> commitTransactionStmt;
 
     void prepareStatements();
     void createDatabase();
+    void createAggregateTables();
+    void addMissingColumns(const std::string& table, const std::vector<std::pair<std::string, std::string> >& columns);
     void runPragmas();
     void clearDatabase();
 
@@ -1,14 +1,17 @@
 #include <stdio.h>
+#include <unistd.h>
 #include <iostream>
 
 #include <map>
 #include <memory>
 #include <set>
+#include <tuple>
 
 #include <pin.H>
 
 #include "sqlwriter.h"
 #include "filter.h"
+#include "elffile.h"
 
 KNOB<string> KnobOutputFile(KNOB_MODE_WRITEONCE, "pintool",
                             "db", "data.db", "specify output file name");
@@ -17,10 +20,36 @@ KNOB<string> KnobOutputFile(KNOB_MODE_WRITEONCE, "pintool",
 KNOB<string> KnobFilterFile(KNOB_MODE_WRITEONCE, "pintool",
                             "filter", "filter.yaml", "specify filter name");
 
+KNOB<string> KnobDatabaseMode(KNOB_MODE_WRITEONCE, "pintool",
+                              "db-mode", "file", "database mode: file or memory (written to the db file at exit)");
+
+KNOB<UINT64> KnobDatabaseMemoryLimit(KNOB_MODE_WRITEONCE, "pintool",
+                                     "db-memory-limit", "4096", "MB an in-memory database may use before it is spilled to the db file, 0 for no limit");
+
+KNOB<INT32> KnobDatabaseBackupStep(KNOB_MODE_WRITEONCE, "pintool",
+                                   "db-backup-step", "-1", "pages copied per step when writing an in-memory database, -1 for a single step");
+
+DatabaseOptions databaseOptions()
+{
+    DatabaseOptions options;
+
+    options.mode = parseDatabaseMode(KnobDatabaseMode.Value());
+    options.memoryLimit = KnobDatabaseMemoryLimit.Value() * 1024 * 1024;
+    options.backupPagesPerStep = KnobDatabaseBackupStep.Value();
+
+    // Results of earlier dynamic runs are kept unless an image changed
+    options.resetDynamicTables = false;
+
+    return options;
+}
+
 struct Manager
 {
     std::unique_ptr<SQLWriter> writer;
     std::unique_ptr<Filter> filter;
+
+    /* Images of a previous run by name, unchanged ones are not indexed again */
+    std::map<std::string, Image> indexedImages;
 };
 
 VOID ImageLoad(IMG img, VOID *v)
@@ -45,12 +74,35 @@ VOID ImageLoad(IMG img, VOID *v)
         return;
     }
 
+    {
+        ElfFile elf(image.name);
+
+        image.buildId = elf.buildId();
+        image.size = elf.size();
+        image.modificationTime = elf.modificationTime();
+    }
+
+    auto indexed = manager->indexedImages.find(image.name);
+
+    if (indexed != manager->indexedImages.end())
+    {
+        if (sameFingerprint(indexed->second, image))
+        {
+            cerr << "Unchanged image:" << image.name << endl;
+            return;
+        }
+
+        writer->deleteImage(image.name);
+        manager->indexedImages.erase(indexed);
+    }
+
     std::set<SourceLocation> foundLocations;
     SourceLocation lastLocation;
 
     writer->insertImage(image);
 
     std::map<std::string, File> files;
+    std::map<std::tuple<std::string, std::string, int, int>, int> functions;
 
     for (SEC sec = IMG_SecHead(img); SEC_Valid(sec); sec = SEC_Next(sec))
     {
@@ -99,10 +151,19 @@ VOID ImageLoad(IMG img, VOID *v)
 
             function.file = files[file].id;
 
-            function.id = writer->functionExists(function);
+            // Rows of an image are only ever written by this run, so duplicates are found in memory
+            auto key = std::make_tuple(function.name, function.prototype, function.file, function.line);
+            auto existing = functions.find(key);
 
-            if (function.id == -1)
+            if (existing == functions.end())
+            {
                 writer->insertFunction(function);
+                functions.insert(std::make_pair(key, function.id));
+            }
+            else
+            {
+                function.id = existing->second;
+            }
 
             for (INS ins = RTN_InsHead(rtn); INS_Valid(ins); ins = INS_Next(ins))
             {
@@ -135,6 +196,8 @@ VOID ImageLoad(IMG img, VOID *v)
             RTN_Close(rtn);
         }
     }
+
+    writer->checkMemoryLimit();
 }
 
 
@@ -164,9 +227,21 @@ int main(int argc, char * argv[])
 
     Manager* manager = new Manager;
 
-    manager->writer.reset(new SQLWriter(KnobOutputFile.Value(), true));
+    // An existing database is updated, only images whose file changed are indexed again
+    bool exists = access(KnobOutputFile.Value().c_str(), F_OK) != -1;
+
+    manager->writer.reset(new SQLWriter(KnobOutputFile.Value(), !exists, databaseOptions()));
     manager->filter.reset(new Filter(KnobFilterFile.Value()));
 
+    for (auto& it : manager->writer->getImages())
+    {
+        auto inserted = manager->indexedImages.insert(std::make_pair(it.name, it));
+
+        // Images indexed twice are never considered unchanged
+        if (!inserted.second)
+            inserted.first->second.size = 0;
+    }
+
     IMG_AddInstrumentFunction(ImageLoad, (void*)manager);
     PIN_AddFiniFunction(Fini, (void*)manager);
 
@@ -0,0 +1,72 @@
+#include "stats.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <vector>
+
+#define TOOL_STAT_NAME(name) #name,
+
+static const char* toolStatNames[] = {
+    TOOL_STATS(TOOL_STAT_NAME)
+};
+
+#undef TOOL_STAT_NAME
+
+const char* toolStatName(ToolStat stat)
+{
+    return toolStatNames[(int)stat];
+}
+
+ToolStats::ToolStats()
+{
+    for (int i = 0; i < (int)ToolStat::Count; i++)
+    {
+        calls[i] = 0;
+        cycles[i] = 0;
+    }
+}
+
+void ToolStats::add(const ToolStats& other)
+{
+    for (int i = 0; i < (int)ToolStat::Count; i++)
+    {
+        calls[i] += other.calls[i];
+        cycles[i] += other.cycles[i];
+    }
+}
+
+std::string ToolStats::summary() const
+{
+    std::vector<int> used;
+
+    for (int i = 0; i < (int)ToolStat::Count; i++)
+    {
+        if (calls[i] > 0)
+            used.push_back(i);
+    }
+
+    std::sort(used.begin(), used.end(), [this](int a, int b)
+    {
+        return cycles[a] > cycles[b];
+    });
+
+    // Shares are relative to the time spent processing buffers
+    UINT64 total = cycles[(int)ToolStat::BufferFull];
+
+    std::string summary;
+    char line[256];
+
+    snprintf(line, sizeof(line), "%-30s %15s %18s %12s %7s\n", "", "calls", "cycles", "cycles/call", "share");
+    summary += line;
+
+    for (int i : used)
+    {
+        double share = total > 0 ? 100.0 * cycles[i] / total : 0;
+
+        snprintf(line, sizeof(line), "%-30s %15llu %18llu %12.1f %6.1f%%\n", toolStatNames[i], (unsigned long long)calls[i], (unsigned long long)cycles[i], (double)cycles[i] / calls[i], share);
+        summary += line;
+    }
+
+    return summary;
+}
@@ -0,0 +1,124 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <string>
+
+#include <pin.H>
+
+#include "asm.h"
+
+/* Counters and rdtsc timers for the hot paths of the tool itself, compiled in with -DPINTOOL_STATS.
+ * Timers are inclusive, handleMemRef contains the time spent in getReference. */
+
+#define TOOL_STATS(X) \
+    X(BufferFull) \
+    X(BufferEntries) \
+    X(HandleTag) \
+    X(HandleCall) \
+    X(HandleCallEnter) \
+    X(HandleRet) \
+    X(HandleLoop) \
+    X(HandleMemRef) \
+    X(HandleMalloc) \
+    X(HandleFree) \
+    X(GetReference) \
+    X(StackOperandHits) \
+    X(RecordTagAccess) \
+    X(InsertImage) \
+    X(InsertFile) \
+    X(InsertFunction) \
+    X(InsertSourceLocation) \
+    X(InsertTag) \
+    X(InsertTagInstruction) \
+    X(InsertTagInstance) \
+    X(InsertThread) \
+    X(InsertCall) \
+    X(InsertCCTNode) \
+    X(InsertSegment) \
+    X(InsertLoopHeader) \
+    X(InsertLoopExecutionSummary) \
+    X(InsertLoopIterationSegment) \
+    X(InsertAccessSampling) \
+    X(InsertSegmentSampling) \
+    X(InsertInstruction) \
+    X(InsertCallTagInstance) \
+    X(InsertInstructionTagInstance) \
+    X(InsertAccess) \
+    X(InsertAccessSummary) \
+    X(InsertReference) \
+    X(InsertConflict) \
+    X(InsertConflictSummary) \
+    X(InsertTagHit)
+
+#define TOOL_STAT_ENUM(name) name,
+
+enum class ToolStat
+{
+    TOOL_STATS(TOOL_STAT_ENUM)
+    Count
+};
+
+#undef TOOL_STAT_ENUM
+
+const char* toolStatName(ToolStat stat);
+
+struct ToolStats
+{
+    ToolStats();
+
+    void add(const ToolStats& other);
+
+    /* One line per used counter, sorted by cycles */
+    std::string summary() const;
+
+    UINT64 calls[(int)ToolStat::Count];
+    UINT64 cycles[(int)ToolStat::Count];
+};
+
+/* Times its scope into stats owned by one thread */
+class ToolStatTimer
+{
+public:
+    ToolStatTimer(ToolStats& stats, ToolStat stat) : stats(stats), stat((int)stat), start(rdtsc()) {}
+
+    ~ToolStatTimer()
+    {
+        stats.calls[stat]++;
+        stats.cycles[stat] += rdtsc() - start;
+    }
+
+private:
+    ToolStats& stats;
+    int stat;
+    UINT64 start;
+};
+
+/* Times its scope into stats shared between threads, the scope may end after the owner's lock is released */
+class SharedToolStatTimer
+{
+public:
+    SharedToolStatTimer(ToolStats& stats, ToolStat stat) : stats(stats), stat((int)stat), start(rdtsc()) {}
+
+    ~SharedToolStatTimer()
+    {
+        __sync_fetch_and_add(&stats.calls[stat], 1);
+        __sync_fetch_and_add(&stats.cycles[stat], rdtsc() - start);
+    }
+
+private:
+    ToolStats& stats;
+    int stat;
+    UINT64 start;
+};
+
+#ifdef PINTOOL_STATS
+#define TOOL_STAT_TIMER(stats, stat) ToolStatTimer toolStatTimer((stats), ToolStat::stat)
+#define TOOL_STAT_SHARED_TIMER(stats, stat) SharedToolStatTimer toolStatTimer((stats), ToolStat::stat)
+#define TOOL_STAT_COUNT(stats, stat, count) ((stats).calls[(int)ToolStat::stat] += (count))
+#else
+#define TOOL_STAT_TIMER(stats, stat)
+#define TOOL_STAT_SHARED_TIMER(stats, stat)
+#define TOOL_STAT_COUNT(stats, stat, count)
+#endif
+
+#endif // STATS_H
@@ -0,0 +1,83 @@
+#include "telemetry.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+
+TelemetryPage* createTelemetryPage(const std::string& file)
+{
+    int fd = open(file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0)
+        return NULL;
+
+    if (ftruncate(fd, sizeof(TelemetryPage)) != 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    void* mapped = mmap(NULL, sizeof(TelemetryPage), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    close(fd);
+
+    if (mapped == MAP_FAILED)
+        return NULL;
+
+    TelemetryPage* page = (TelemetryPage*)mapped;
+
+    memset(page, 0, sizeof(TelemetryPage));
+
+    page->header.version = telemetryVersion;
+    page->header.threads = telemetryThreads;
+    page->header.pid = getpid();
+
+    // Readers check the magic last, a page with it is complete
+    __atomic_store_n(&page->header.magic, telemetryMagic, __ATOMIC_RELEASE);
+
+    return page;
+}
+
+const TelemetryPage* openTelemetryPage(const std::string& file)
+{
+    int fd = open(file.c_str(), O_RDONLY);
+
+    if (fd < 0)
+        return NULL;
+
+    struct stat info;
+
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(TelemetryPage))
+    {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    void* mapped = mmap(NULL, sizeof(TelemetryPage), PROT_READ, MAP_SHARED, fd, 0);
+
+    close(fd);
+
+    if (mapped == MAP_FAILED)
+        return NULL;
+
+    const TelemetryPage* page = (const TelemetryPage*)mapped;
+
+    if (__atomic_load_n(&page->header.magic, __ATOMIC_ACQUIRE) != telemetryMagic || page->header.version != telemetryVersion)
+    {
+        closeTelemetryPage(page);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return page;
+}
+
+void closeTelemetryPage(const TelemetryPage* page)
+{
+    munmap((void*)page, sizeof(TelemetryPage));
+}
@@ -0,0 +1,68 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+
+#include <string>
+
+/* Stats page the dynamic tool publishes with -telemetry while the program runs, read by pintool_monitor. Every
+ * thread writes only its own cache line with relaxed stores, readers never take a lock. */
+
+static const uint64_t telemetryMagic = 0x6c656d656c657450ULL;
+static const uint32_t telemetryVersion = 1;
+
+/* Threads with a higher THREADID are not published */
+static const uint32_t telemetryThreads = 256;
+
+enum class TelemetryState : uint64_t
+{
+    Unused = 0,
+    Running = 1,
+    Stopped = 2
+};
+
+struct TelemetryHeader
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t threads;
+    int64_t pid;
+
+    /* Rows written to the database by all threads, published under the writer lock */
+    uint64_t rows;
+} __attribute__((aligned(64)));
+
+struct TelemetryThread
+{
+    uint64_t state;
+    uint64_t thread;
+
+    uint64_t events;
+    uint64_t buffers;
+    uint64_t callDepth;
+    uint64_t tagInstances;
+    uint64_t references;
+} __attribute__((aligned(64)));
+
+struct TelemetryPage
+{
+    TelemetryHeader header;
+    TelemetryThread threads[telemetryThreads];
+};
+
+static inline void publish(uint64_t* field, uint64_t value)
+{
+    __atomic_store_n(field, value, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t observe(const uint64_t* field)
+{
+    return __atomic_load_n(field, __ATOMIC_RELAXED);
+}
+
+/* Create the page file of this process or map an existing one, NULL and errno set if it fails */
+TelemetryPage* createTelemetryPage(const std::string& file);
+const TelemetryPage* openTelemetryPage(const std::string& file);
+void closeTelemetryPage(const TelemetryPage* page);
+
+#endif // TELEMETRY_H
@@ -2,9 +2,22 @@
 
 #include <time.h>
 
+#include <algorithm>
+#include <limits>
+#include <iterator>
+
 #include "exception.h"
 #include "asm.h"
 
+/* Aggregated accesses kept in memory before they are written out */
+static const std::size_t maxAccessSummaries = 1 << 16;
+
+/* Addresses remembered per open loop for its loop-carried dependencies */
+static const std::size_t maxLoopShadow = 1 << 16;
+
+/* Fewest memory instructions sampled by the overhead control, one in this many */
+static const UINT64 maxAccessSamplingPeriod = 1 << 16;
+
 ThreadManager::ThreadManager(Manager *manager, THREADID tid) : manager(manager), tid(tid)
 {
     PIN_MutexInit(&mutex);
@@ -19,6 +32,36 @@ ThreadManager::ThreadManager(Manager *manager, THREADID tid) : manager(manager),
     ignoreAccesses = false;
     ignoreCalls = false;
 
+    accessSummaryCount = 0;
+
+    pendingType = BuferEntryType::MemRef;
+
+    frameGeneration = 1;
+
+    for (auto& it : frameReferences)
+        it.generation = 0;
+
+    applicationStartTSC = startTSC;
+    accessSamplingPeriod = 1;
+    accessSamplingCountdown = 1;
+    samplingRandom = (UINT64)tid * 0x9e3779b97f4a7c15ULL + 1;
+    samplingSegment = -1;
+    currentSampling = NULL;
+
+    telemetry = manager->getTelemetryThread(tid);
+
+    // Slots are reused by threads getting the THREADID of a stopped one
+    if (telemetry != NULL)
+    {
+        publish(&telemetry->thread, self.id);
+        publish(&telemetry->events, 0);
+        publish(&telemetry->buffers, 0);
+        publish(&telemetry->callDepth, 0);
+        publish(&telemetry->tagInstances, 0);
+        publish(&telemetry->references, 0);
+        publish(&telemetry->state, (uint64_t)TelemetryState::Running);
+    }
+
     updateChecks();
 }
 
@@ -30,10 +73,29 @@ ThreadManager::~ThreadManager()
 void ThreadManager::bufferFull(BufferEntry * entries, UINT64 count)
 {
     lock();
+
+    TOOL_STAT_TIMER(stats, BufferFull);
+    TOOL_STAT_COUNT(stats, BufferEntries, count);
+
+    UINT64 analysisStartTSC = manager->slowdownBudget > 0 ? rdtsc() : 0;
+
     for(UINT64 i = 0; i < count; i++)
     {
         handleEntry(&entries[i]);
     }
+
+    // The application ran from the end of the last buffer until this one was full
+    if (manager->slowdownBudget > 0)
+    {
+        UINT64 end = rdtsc();
+
+        controlOverhead(analysisStartTSC - applicationStartTSC, end - analysisStartTSC);
+        applicationStartTSC = end;
+    }
+
+    if (telemetry != NULL)
+        publishTelemetry(count);
+
     unlock();
 }
 
@@ -45,6 +107,19 @@ void ThreadManager::threadStopped()
 
     manager->writer.insertThread(self);
 
+#ifdef PINTOOL_STATS
+    manager->writeToolStats(self.id, stats);
+#endif
+
+    if (manager->aggregateAccesses)
+        flushAccesses();
+
+    for (auto& it : conflictSummaries) {
+        manager->writer.insertConflictSummary(it.second);
+    }
+
+    conflictSummaries.clear();
+
     while (!callStack.empty())
     {
         std::ostringstream oss;
@@ -52,6 +127,15 @@ void ThreadManager::threadStopped()
         oss << "Closing " << callStack.back().call.function << " a end of thread";
         Warn("threadStopped", oss.str());
 
+        endCallLoops(self.endTSC - this->startTSC);
+
+        if (manager->aggregateCalls)
+        {
+            accountCCTCall(self.endTSC - this->startTSC);
+            callStack.pop_back();
+            continue;
+        }
+
         insertCallTagInstance(callStack.back());
 
         Call c = callStack.back().call;
@@ -61,6 +145,28 @@ void ThreadManager::threadStopped()
 
         manager->writer.insertCall(c);
     }
+
+    if (manager->aggregateCalls)
+        flushCCT();
+
+    flushSampling();
+
+    if (telemetry != NULL)
+    {
+        publish(&telemetry->callDepth, 0);
+        publish(&telemetry->tagInstances, 0);
+        publish(&telemetry->state, (uint64_t)TelemetryState::Stopped);
+    }
+}
+
+void ThreadManager::publishTelemetry(UINT64 events)
+{
+    // Only this thread writes its slot, reading it back needs no synchronisation
+    publish(&telemetry->events, telemetry->events + events);
+    publish(&telemetry->buffers, telemetry->buffers + 1);
+    publish(&telemetry->callDepth, callStack.size());
+    publish(&telemetry->tagInstances, currentTagInstances.size());
+    publish(&telemetry->references, observe(&manager->referenceCount));
 }
 
 void ThreadManager::handleEntry(BufferEntry * entry)
@@ -94,8 +200,57 @@ void ThreadManager::handleEntry(BufferEntry * entry)
             */
 
         checkAllocation(entry->data.memref.tsc);
+
+        if (((AccessInstructionDetails*)entry->data.memref.accessDetails)->accesses.size() > memRefAddresses)
+        {
+            pendingType = BuferEntryType::MemRef;
+            pendingMemRef = entry->data.memref;
+            break;
+        }
+
+        if (processAccessesComputed && sampleAccess())
+            handleMemRef(entry->data.memref.tsc - this->startTSC, (AccessInstructionDetails*)entry->data.memref.accessDetails, entry->data.memref.addresses, entry->data.memref.rsp);
+        break;
+    case BuferEntryType::BlockAccesses:
+        checkAllocation(entry->data.blockAccesses.tsc);
+
+        if (((BlockAccessDetails*)entry->data.blockAccesses.block)->registers.size() > memRefAddresses)
+        {
+            pendingType = BuferEntryType::BlockAccesses;
+            pendingBlock = entry->data.blockAccesses;
+            break;
+        }
+
         if (processAccessesComputed)
-            handleMemRef((AccessInstructionDetails*)entry->data.memref.accessDetails, entry->data.memref.addresses, entry->data.memref.rsp);
+            handleBlockAccesses(entry->data.blockAccesses.tsc - this->startTSC, (BlockAccessDetails*)entry->data.blockAccesses.block, entry->data.blockAccesses.registers, entry->data.blockAccesses.rsp);
+        break;
+    case BuferEntryType::MemRefAddresses:
+        if (pendingType == BuferEntryType::BlockAccesses)
+        {
+            if (processAccessesComputed)
+            {
+                ADDRINT registers[maxMemRefAddresses];
+
+                std::copy(pendingBlock.registers, pendingBlock.registers + memRefAddresses, registers);
+                std::copy(entry->data.memrefAddresses.addresses, entry->data.memrefAddresses.addresses + moreMemRefAddresses, registers + memRefAddresses);
+
+                handleBlockAccesses(pendingBlock.tsc - this->startTSC, (BlockAccessDetails*)pendingBlock.block, registers, pendingBlock.rsp);
+            }
+        }
+        else if (processAccessesComputed && sampleAccess())
+        {
+            ADDRINT addresses[maxMemRefAddresses];
+
+            std::copy(pendingMemRef.addresses, pendingMemRef.addresses + memRefAddresses, addresses);
+            std::copy(entry->data.memrefAddresses.addresses, entry->data.memrefAddresses.addresses + moreMemRefAddresses, addresses + memRefAddresses);
+
+            handleMemRef(pendingMemRef.tsc - this->startTSC, (AccessInstructionDetails*)pendingMemRef.accessDetails, addresses, pendingMemRef.rsp);
+        }
+        break;
+    case BuferEntryType::Loop:
+        checkAllocation(entry->data.loop.tsc);
+        if (processCallsComputed)
+            handleLoop(entry->data.loop.tsc - this->startTSC, (int)entry->data.loop.loopId, entry->data.loop.type);
         break;
     default:
         CorruptedBufferException("Invalid entry type");
@@ -106,18 +261,26 @@ void ThreadManager::handleEntry(BufferEntry * entry)
 
 void ThreadManager::handleTag(UINT64 tsc, int tagInstructionId, ADDRINT address)
 {
+    TOOL_STAT_TIMER(stats, HandleTag);
+
     if (tagInstructionId == lastTagHitId && address != lastHitAddress)
         return;
 
     lastTagHitId = tagInstructionId;
     lastHitAddress = address;
 
+    // Summaries and instructions are linked to the tag instances active when they were created
+    if (manager->aggregateAccesses)
+        flushAccesses();
+
+    instructionCache.clear();
+
     // manager->writer.insertTagHit(tsc, tagInstructionId, self.id);
 
     TagInstruction& tagInstruction = manager->tagInstructionIdMap[tagInstructionId];
     Tag& tag = manager->tagIdTagMap[tagInstruction.tag];
 
-    std::list<TagInstance>::iterator tagInstance = findCurrentTagInstance(tag.id);
+    TagInstance* tagInstance = findCurrentTagInstance(tag.id);
 
     switch (tag.type)
     {
@@ -169,6 +332,8 @@ void ThreadManager::handleTag(UINT64 tsc, int tagInstructionId, ADDRINT address)
 
 void ThreadManager::handleCall(UINT64 tsc, int location, UINT64 rsp)
 {
+    TOOL_STAT_TIMER(stats, HandleCall);
+
     callStack.back().rsp = rsp;
 
     lastCallTSC = tsc;
@@ -177,8 +342,11 @@ void ThreadManager::handleCall(UINT64 tsc, int location, UINT64 rsp)
 
 void ThreadManager::handleCallEnter(UINT64 tsc, int functionId, UINT64 rbp, UINT64 rsp)
 {
+    TOOL_STAT_TIMER(stats, HandleCallEnter);
+
+    frameGeneration++;
+
     Call c;
-    c.genId();
 
     if (rbp < rsp)
     {
@@ -186,6 +354,37 @@ void ThreadManager::handleCallEnter(UINT64 tsc, int functionId, UINT64 rbp, UINT
         rbp = rsp;
     }
 
+    if (manager->aggregateCalls)
+    {
+        int node;
+
+        if (callStack.empty())
+        {
+            node = getCCTNode(-1, -1, functionId);
+            c.start = tsc;
+        }
+        else
+        {
+            node = getCCTNode(callStack.back().cctNode, lastCallLocation, functionId);
+            c.start = lastCallTSC;
+        }
+
+        c.function = functionId;
+        c.thread = self.id;
+
+        callStack.push_back({c, cct[node].segment, rbp, rsp, SmallSet<int, 4>(), node, 0});
+
+        SmallSet<int, 4>& callTagInstances = callStack.back().tagInstances;
+
+        for (auto& it : currentTagInstances) {
+            callTagInstances.insert(it.id);
+        }
+
+        return;
+    }
+
+    c.genId();
+
     if(callStack.empty())
     {
         c.instruction = -1;
@@ -194,16 +393,7 @@ void ThreadManager::handleCallEnter(UINT64 tsc, int functionId, UINT64 rbp, UINT
     }
     else
     {
-        Instruction i;
-
-        i.segment = callStack.back().segment;
-        i.type = InstructionType::Call;
-        i.line = manager->locationDetails[lastCallLocation].line;
-        i.column = manager->locationDetails[lastCallLocation].column;
-        manager->writer.insertInstruction(i);
-        insertCurrentTagInstances(i.id);
-
-        c.instruction = i.id;
+        c.instruction = getInstruction(InstructionType::Call, lastCallLocation);
         c.start = lastCallTSC;
     }
 
@@ -215,9 +405,9 @@ void ThreadManager::handleCallEnter(UINT64 tsc, int functionId, UINT64 rbp, UINT
     s.call = c.id;
     s.type = SegmentType::Standard;
     manager->writer.insertSegment(s);
-    callStack.push_back({c, s.id, rbp, rsp});
+    callStack.push_back({c, s.id, rbp, rsp, SmallSet<int, 4>(), -1, 0});
 
-    std::set<int>& callTagInstances = callStack.back().tagInstances;
+    SmallSet<int, 4>& callTagInstances = callStack.back().tagInstances;
 
     for (auto& it : currentTagInstances) {
         callTagInstances.insert(it.id);
@@ -226,6 +416,11 @@ void ThreadManager::handleCallEnter(UINT64 tsc, int functionId, UINT64 rbp, UINT
 
 void ThreadManager::handleRet(UINT64 tsc, int functionId, UINT64 rsp)
 {
+    TOOL_STAT_TIMER(stats, HandleRet);
+
+    // The references of the caller's frame may be cleared with the callee's
+    frameGeneration++;
+
     if (callStack.empty())
         CorruptedBufferException("Return from empty callstack");
 
@@ -239,18 +434,52 @@ void ThreadManager::handleRet(UINT64 tsc, int functionId, UINT64 rsp)
 
         Warn("handleRet", oss.str());
 
+        endCallLoops(tsc);
         clearStackReferences(callStack.back().rbp, rsp);
         insertCallTagInstance(callStack.back());
 
+        if (manager->aggregateAccesses && !manager->aggregateCalls)
+            flushSegmentAccesses(callStack.back().segment);
+
+        // Frames left by longjmp, unwinding or tail calls still count as invocations of their context
+        if (manager->aggregateCalls)
+        {
+            accountCCTCall(tsc);
+        }
+        else
+        {
+            releaseInstructions(callStack.back().segment);
+            flushSegmentSampling(callStack.back().segment);
+        }
+
         callStack.pop_back();
+
+        if (callStack.empty())
+            break;
+
         c = callStack.back().call;
     }
 
     if (callStack.empty())
         CorruptedBufferException("Could not find call in callstack");
 
+    endCallLoops(tsc);
     clearStackReferences(callStack.back().rbp, rsp);
+
+    // Segments of a calling context tree live until the end of the thread
+    if (manager->aggregateAccesses && !manager->aggregateCalls)
+        flushSegmentAccesses(callStack.back().segment);
+
+    if (manager->aggregateCalls)
+    {
+        accountCCTCall(tsc);
+        callStack.pop_back();
+        return;
+    }
+
     insertCallTagInstance(callStack.back());
+    releaseInstructions(callStack.back().segment);
+    flushSegmentSampling(callStack.back().segment);
 
     callStack.pop_back();
 
@@ -259,6 +488,305 @@ void ThreadManager::handleRet(UINT64 tsc, int functionId, UINT64 rsp)
     manager->writer.insertCall(c);
 }
 
+int ThreadManager::getCCTNode(int parent, int callSite, int function)
+{
+    CCTKey key = {parent, callSite, function};
+
+    auto it = cctIndex.find(key);
+
+    if (it != cctIndex.end())
+        return it->second;
+
+    CCTNode node;
+    node.genId();
+
+    node.parent = parent >= 0 ? cct[parent].id : -1;
+    node.thread = self.id;
+    node.function = function;
+
+    if (callSite >= 0)
+    {
+        node.callLine = manager->locationDetails[callSite].line;
+        node.callColumn = manager->locationDetails[callSite].column;
+    }
+    else
+    {
+        node.callLine = -1;
+        node.callColumn = -1;
+    }
+
+    node.count = 0;
+    node.inclusive = 0;
+    node.exclusive = 0;
+    node.minDuration = std::numeric_limits<UINT64>::max();
+    node.maxDuration = 0;
+
+    // One segment per context, accesses of every invocation share it
+    Segment s;
+
+    s.call = -1;
+    s.type = SegmentType::Standard;
+    manager->writer.insertSegment(s);
+
+    node.segment = s.id;
+
+    cct.push_back(node);
+    cctIndex.insert(std::make_pair(key, cct.size() - 1));
+
+    return cct.size() - 1;
+}
+
+void ThreadManager::accountCCTCall(UINT64 end)
+{
+    CallData& data = callStack.back();
+    CCTNode& node = cct[data.cctNode];
+
+    UINT64 duration = end - data.call.start;
+
+    node.count++;
+    node.inclusive += duration;
+    node.exclusive += duration - data.childTime;
+    node.minDuration = std::min(node.minDuration, duration);
+    node.maxDuration = std::max(node.maxDuration, duration);
+
+    if (callStack.size() > 1)
+        std::prev(callStack.end(), 2)->childTime += duration;
+}
+
+void ThreadManager::flushCCT()
+{
+    for (auto& node : cct)
+    {
+        manager->writer.insertCCTNode(node);
+    }
+
+    cct.clear();
+    cctIndex.clear();
+}
+
+void ThreadManager::handleLoop(UINT64 tsc, int loopId, LoopEventType type)
+{
+    TOOL_STAT_TIMER(stats, HandleLoop);
+
+    if (callStack.empty())
+        return;
+
+    std::size_t depth = callStack.size();
+
+    // Only loops of the current call can be continued or left
+    std::size_t first = loopStack.size();
+
+    while (first > 0 && loopStack[first - 1].depth == depth)
+        first--;
+
+    std::size_t found = loopStack.size();
+
+    for (std::size_t i = first; i < loopStack.size(); i++)
+    {
+        if (loopStack[i].execution.loop == loopId)
+        {
+            found = i;
+            break;
+        }
+    }
+
+    if (type == LoopEventType::Exit)
+    {
+        endLoops(found, tsc);
+        return;
+    }
+
+    if (found < loopStack.size())
+    {
+        // Loops nested in this one were left by jumping back to its header
+        endLoops(found + 1, tsc);
+
+        LoopData& loop = loopStack.back();
+
+        endLoopIteration(loop, tsc);
+        loop.iteration++;
+        startLoopIteration(loop, tsc);
+
+        return;
+    }
+
+    LoopData loop;
+
+    loop.execution.genId();
+    loop.execution.loop = loopId;
+    loop.execution.thread = self.id;
+    loop.execution.segment = -1;
+    loop.execution.start = tsc;
+    loop.execution.iterations = 0;
+    loop.execution.minIteration = std::numeric_limits<UINT64>::max();
+    loop.execution.maxIteration = 0;
+    loop.execution.dependencies = 0;
+    loop.execution.minDistance = -1;
+
+    loop.depth = depth;
+    loop.parentSegment = callStack.back().segment;
+    loop.iteration = 0;
+
+    loopStack.push_back(loop);
+    startLoopIteration(loopStack.back(), tsc);
+}
+
+void ThreadManager::startLoopIteration(LoopData& loop, UINT64 tsc)
+{
+    if (loop.iteration == 0 || manager->loopIterationSegments)
+    {
+        Segment s;
+
+        // Calls of a calling context tree have no row to point to
+        s.call = manager->aggregateCalls ? -1 : callStack.back().call.id;
+        s.type = SegmentType::Loop;
+        manager->writer.insertSegment(s);
+
+        if (loop.iteration == 0)
+            loop.execution.segment = s.id;
+
+        loop.segment = s.id;
+        callStack.back().segment = s.id;
+    }
+
+    loop.iterationStart = tsc;
+}
+
+void ThreadManager::endLoopIteration(LoopData& loop, UINT64 tsc)
+{
+    UINT64 duration = tsc - loop.iterationStart;
+
+    loop.execution.iterations++;
+    loop.execution.minIteration = std::min(loop.execution.minIteration, duration);
+    loop.execution.maxIteration = std::max(loop.execution.maxIteration, duration);
+
+    if (manager->loopIterationSegments)
+    {
+        LoopIterationSegment iteration;
+
+        iteration.execution = loop.execution.id;
+        iteration.iteration = loop.iteration;
+        iteration.segment = loop.segment;
+        iteration.start = loop.iterationStart;
+        iteration.end = tsc;
+
+        manager->writer.insertLoopIterationSegment(iteration);
+
+        if (manager->aggregateAccesses)
+            flushSegmentAccesses(loop.segment);
+
+        releaseInstructions(loop.segment);
+        flushSegmentSampling(loop.segment);
+    }
+}
+
+void ThreadManager::endLoops(std::size_t count, UINT64 tsc)
+{
+    while (loopStack.size() > count)
+    {
+        LoopData& loop = loopStack.back();
+
+        endLoopIteration(loop, tsc);
+        loop.execution.end = tsc;
+
+        if (!manager->loopIterationSegments)
+        {
+            if (manager->aggregateAccesses)
+                flushSegmentAccesses(loop.segment);
+
+            releaseInstructions(loop.segment);
+            flushSegmentSampling(loop.segment);
+        }
+
+        // Loops are always ended before their call is popped
+        callStack.back().segment = loop.parentSegment;
+
+        manager->writer.insertLoopExecutionSummary(loop.execution);
+
+        loopStack.pop_back();
+    }
+}
+
+void ThreadManager::endCallLoops(UINT64 tsc)
+{
+    std::size_t count = loopStack.size();
+
+    while (count > 0 && loopStack[count - 1].depth >= callStack.size())
+        count--;
+
+    endLoops(count, tsc);
+}
+
+/* Forgets the addresses not touched in the current iteration, all of them if the iteration alone fills the shadow.
+ * Dependencies through forgotten addresses are not counted, so streaming loops stay bounded. */
+void ThreadManager::pruneLoopShadow(LoopData& loop)
+{
+    for (auto it = loop.shadow.begin(); it != loop.shadow.end();)
+    {
+        if (it->second.lastRead != loop.iteration && it->second.lastWrite != loop.iteration)
+            it = loop.shadow.erase(it);
+        else
+            ++it;
+    }
+
+    // At least half of the shadow is free afterwards, so pruning stays rare
+    if (loop.shadow.size() > maxLoopShadow / 2)
+        loop.shadow.clear();
+}
+
+void ThreadManager::recordLoopAccess(ADDRINT address, int reference, AccessType type)
+{
+    for (auto& loop : loopStack)
+    {
+        auto it = loop.shadow.find(address);
+
+        // A new reference at the same address, e.g. memory allocated again, starts without history
+        if (it == loop.shadow.end())
+        {
+            if (loop.shadow.size() >= maxLoopShadow)
+                pruneLoopShadow(loop);
+
+            it = loop.shadow.insert(std::make_pair(address, (LoopShadow){reference, -1, -1, -1})).first;
+        }
+        else if (it->second.reference != reference)
+        {
+            it->second = {reference, -1, -1, -1};
+        }
+
+        LoopShadow& shadow = it->second;
+        int source = -1;
+
+        if (shadow.lastWrite != loop.iteration)
+            source = shadow.lastWrite;
+
+        if (type == AccessType::Read)
+        {
+            if (shadow.lastRead != loop.iteration)
+            {
+                shadow.previousRead = shadow.lastRead;
+                shadow.lastRead = loop.iteration;
+            }
+        }
+        else
+        {
+            int read = shadow.lastRead != loop.iteration ? shadow.lastRead : shadow.previousRead;
+
+            source = std::max(source, read);
+            shadow.lastWrite = loop.iteration;
+        }
+
+        if (source >= 0)
+        {
+            int distance = loop.iteration - source;
+
+            loop.execution.dependencies++;
+
+            if (loop.execution.minDistance < 0 || distance < loop.execution.minDistance)
+                loop.execution.minDistance = distance;
+        }
+    }
+}
+
 void ThreadManager::handleLocation(const LocationDetails& location)
 {
     if (callStack.empty())
@@ -299,6 +827,8 @@ void ThreadManager::checkAllocation(UINT64 tsc)
 
 void ThreadManager::handleFree(ADDRINT address)
 {
+    TOOL_STAT_TIMER(stats, HandleFree);
+
     manager->lockReferences();
     auto it = manager->references.find(address);
 
@@ -309,22 +839,13 @@ void ThreadManager::handleFree(ADDRINT address)
 
     if(!it->second.wasAccessed) {
         manager->references.erase(address);
+        publish(&manager->referenceCount, manager->references.size());
         manager->unlockReferences();
         return;
     }
 
     if (!callStack.empty()){
-        Instruction instr;
-
-        instr.type = InstructionType::Free;
-        instr.segment = callStack.back().segment;
-        instr.line = manager->locationDetails[lastCallLocation].line;
-        instr.column = manager->locationDetails[lastCallLocation].line;
-
-        manager->writer.insertInstruction(instr);
-        insertCurrentTagInstances(instr.id);
-
-        it->second.ref.deallocator = instr.id;
+        it->second.ref.deallocator = getInstruction(InstructionType::Free, lastCallLocation);
     } else {
         it->second.ref.deallocator = -1;
     }
@@ -332,33 +853,25 @@ void ThreadManager::handleFree(ADDRINT address)
     manager->writer.insertReference(it->second.ref);
 
     manager->references.erase(it);
+    publish(&manager->referenceCount, manager->references.size());
 
     manager->unlockReferences();
 }
 
 void ThreadManager::handleMalloc(ADDRINT address, UINT64 size)
 {
+    TOOL_STAT_TIMER(stats, HandleMalloc);
+
     ReferenceData data;
     data.ref.genId();
     data.ref.size = size;
     data.ref.type = ReferenceType::Heap;
-
-    std::stringstream stream;
-    stream << std::hex << address;
-    data.ref.name = stream.str();
+    data.ref.address = address;
+    data.ref.stackDelta = 0;
+    data.ref.function = -1;
 
     if(!callStack.empty()) {
-        Instruction instr;
-
-        instr.type = InstructionType::Alloc;
-        instr.segment = callStack.back().segment;
-        instr.line = manager->locationDetails[lastCallLocation].line;
-        instr.column = manager->locationDetails[lastCallLocation].line;
-
-        manager->writer.insertInstruction(instr);
-        insertCurrentTagInstances(instr.id);
-
-        data.ref.allocator = instr.id;
+        data.ref.allocator = getInstruction(InstructionType::Alloc, lastCallLocation);
     } else {
         data.ref.allocator = -1;
     }
@@ -370,6 +883,7 @@ void ThreadManager::handleMalloc(ADDRINT address, UINT64 size)
     //     CorruptedBufferException("Address reused by allocation");
 
     manager->references.insert(std::make_pair(address, data));
+    publish(&manager->referenceCount, manager->references.size());
     manager->unlockReferences();
 }
 
@@ -412,6 +926,7 @@ void ThreadManager::clearStackReferences(ADDRINT from, ADDRINT rsp)
     }
 
     manager->references.erase(itStart, itEnd);
+    publish(&manager->referenceCount, manager->references.size());
 
     manager->unlockReferences();
 }
@@ -425,8 +940,42 @@ void ThreadManager::storeAllocation(AllocData allocation)
     unlock();
 }
 
+ReferenceData* ThreadManager::getStackOperandReference(const MemoryOperationDetails& operand, ADDRINT address, UINT64 rsp)
+{
+    if (operand.stack == StackOperand::RedZone)
+    {
+        TOOL_STAT_COUNT(stats, StackOperandHits, 1);
+        return &manager->redZone;
+    }
+
+    if (operand.stack != StackOperand::Frame || address < rsp || address >= callStack.back().rbp)
+        return NULL;
+
+    FrameReference& slot = frameReferences[(address >> 3) % frameReferenceSlots];
+
+    if (slot.generation == frameGeneration && slot.address == address)
+    {
+        TOOL_STAT_COUNT(stats, StackOperandHits, 1);
+        return slot.data;
+    }
+
+    // Only this thread clears references in its frames, the node stays valid until the frame changes
+    manager->lockReferences();
+
+    ReferenceData* data = &getReference(address, operand.size, rsp);
+    data->wasAccessed = true;
+
+    manager->unlockReferences();
+
+    slot = {address, frameGeneration, data};
+
+    return data;
+}
+
 ReferenceData &ThreadManager::getReference(ADDRINT address, int size, UINT64 rsp)
 {
+    TOOL_STAT_TIMER(stats, GetReference);
+
     {
         auto it = manager->references.find(address);
 
@@ -449,98 +998,61 @@ ReferenceData &ThreadManager::getReference(ADDRINT address, int size, UINT64 rsp
         ADDRINT rbp = callStack.back().rbp;
 
         if (address < rbp && address >= rsp) { // Most common case, stack variable for the last function
-            ReferenceData data;
-            data.ref.genId();
-            data.ref.size = size;
-            data.ref.type = ReferenceType::Stack;
-            data.ref.allocator = -1;
-            data.ref.deallocator = -1;
-
-            std::stringstream stream;
-            stream << "S: " << std::hex << (ADDRDELTA)address << ':' << std::dec << (ADDRDELTA) ((ADDRDELTA)address - (ADDRDELTA)rbp) << ':' << callStack.back().call.function;
-            data.ref.name = stream.str();
-            data.isStack = true;
-            data.stackDelta = (ADDRDELTA) ((ADDRDELTA)address - (ADDRDELTA)rbp);
-            data.stackFctAlloc = callStack.back().call.function;
-
-            manager->writer.insertReference(data.ref);
-
-            return manager->references.insert(std::make_pair(address, data)).first->second;
+            return createReference(address, size, ReferenceType::Stack, &callStack.back());
         } else if (address < rsp && address >= rsp - 128) { // Red Zone is only valid for the last function in the stack
             return manager->redZone;
         } else if (address < callStack.front().rbp && address >= rsp){ // We are in the stack
             for (auto it = callStack.rbegin(); it != callStack.rend(); it++) {
                 if (address < it->rbp && address >= it->rsp) { // Stack variables between rbp and rsp of a parent
-                    ReferenceData data;
-                    data.ref.genId();
-                    data.ref.size = size;
-                    data.ref.type = ReferenceType::Stack;
-                    data.ref.allocator = -1;
-                    data.ref.deallocator = -1;
-
-                    std::stringstream stream;
-                    stream << "S: " << std::hex << (ADDRDELTA)address << ':' << std::dec << (ADDRDELTA) ((ADDRDELTA)address - (ADDRDELTA)it->rbp) << ':' << it->call.function;
-                    data.ref.name = stream.str();
-                    data.isStack = true;
-                    data.stackDelta = (ADDRDELTA) ((ADDRDELTA)address - (ADDRDELTA)it->rbp);
-                    data.stackFctAlloc = it->call.function;
-
-                    manager->writer.insertReference(data.ref);
-
-                    return manager->references.insert(std::make_pair(address, data)).first->second;
+                    return createReference(address, size, ReferenceType::Stack, &*it);
                 } else if (address >= it->rbp) { // Arguments above rbp
-                    ReferenceData data;
-                    data.ref.genId();
-                    data.ref.size = size;
-                    data.ref.type = ReferenceType::Parameter;
-                    data.ref.allocator = -1;
-                    data.ref.deallocator = -1;
-
-                    std::stringstream stream;
-                    stream << "P: " << std::hex << (ADDRDELTA)address << ':' << std::dec << (ADDRDELTA) ((ADDRDELTA)address - (ADDRDELTA)it->rbp) << ':' << it->call.function;
-                    data.ref.name = stream.str();
-                    data.isStack = true;
-                    data.stackDelta = (ADDRDELTA) ((ADDRDELTA)address - (ADDRDELTA)it->rbp);
-                    data.stackFctAlloc = it->call.function;
-
-                    manager->writer.insertReference(data.ref);
-
-                    return manager->references.insert(std::make_pair(address, data)).first->second;
+                    return createReference(address, size, ReferenceType::Parameter, &*it);
                 }
             }
         }
     }
 
+    return createReference(address, size, ReferenceType::Global, NULL);
+}
+
+ReferenceData &ThreadManager::createReference(ADDRINT address, int size, ReferenceType type, const CallData* frame)
+{
     ReferenceData data;
     data.ref.genId();
     data.ref.size = size;
-    data.ref.type = ReferenceType::Global;
+    data.ref.type = type;
     data.ref.allocator = -1;
     data.ref.deallocator = -1;
+    data.ref.address = address;
 
-    std::stringstream stream;
-    stream << "G: " << std::hex << address;
-    data.ref.name = stream.str();
+    if (frame != NULL) {
+        data.isStack = true;
+        data.ref.stackDelta = (ADDRDELTA) ((ADDRDELTA)address - (ADDRDELTA)frame->rbp);
+        data.ref.function = frame->call.function;
+    } else {
+        data.ref.stackDelta = 0;
+        data.ref.function = -1;
+    }
 
     manager->writer.insertReference(data.ref);
 
-    return manager->references.insert(std::make_pair(address, data)).first->second;
+    ReferenceData& reference = manager->references.insert(std::make_pair(address, data)).first->second;
+    publish(&manager->referenceCount, manager->references.size());
+
+    return reference;
 }
 
-void ThreadManager::handleMemRef(AccessInstructionDetails* details, ADDRINT addresses[7], UINT64 rsp)
+void ThreadManager::handleMemRef(UINT64 tsc, AccessInstructionDetails* details, ADDRINT* addresses, UINT64 rsp)
 {
+    TOOL_STAT_TIMER(stats, HandleMemRef);
+
     if (callStack.empty())
         return;
 
-    Instruction instr;
-
-    instr.type = InstructionType::Access;
-    instr.segment = callStack.back().segment;
-    instr.line = manager->locationDetails[details->location].line;
-    instr.column = manager->locationDetails[details->location].column;
+    int instruction = -1;
 
-    manager->writer.insertInstruction(instr);
-    insertCurrentTagInstances(instr.id);
+    if (!manager->aggregateAccesses)
+        instruction = getInstruction(InstructionType::Access, details->location);
 
     for (int i=0;i < details->accesses.size(); i++) {
         Access a;
@@ -548,6 +1060,17 @@ void ThreadManager::handleMemRef(AccessInstructionDetails* details, ADDRINT addr
         ReferenceData* data;
 
         int refid;
+
+        data = getStackOperandReference(details->accesses[i], addresses[i], rsp);
+
+        if (data != NULL)
+        {
+            refid = data->ref.id;
+
+            if (!data->isStack)
+                data = NULL;
+        }
+        else
         {
             manager->lockReferences();
 
@@ -563,7 +1086,7 @@ void ThreadManager::handleMemRef(AccessInstructionDetails* details, ADDRINT addr
         }
 
         a.reference = refid;
-        a.instruction = instr.id;
+        a.instruction = instruction;
         a.position = i;
         a.address = addresses[i];
         a.size = details->accesses[i].size;
@@ -571,43 +1094,308 @@ void ThreadManager::handleMemRef(AccessInstructionDetails* details, ADDRINT addr
             if (details->accesses[i].isRead) {
             a.type = AccessType::Read;
 
-            manager->writer.insertAccess(a);
+            if (manager->aggregateAccesses)
+                a.id = aggregateAccess(tsc, details, a);
+            else
+                manager->writer.insertAccess(a);
 
             if (refid != manager->redZone.ref.id)
             {
-                for (auto& it: currentTagInstances) {
-                    recordTagAccess(it, a.address, a.reference, a.id, a.type);
+                for (auto it = currentTasks.rbegin(); it != currentTasks.rend(); it++) {
+                    recordTagAccess(*it, a.address, a.size, a.reference, a.id, a.type);
                 }
+
+                if (!loopStack.empty())
+                    recordLoopAccess(a.address, a.reference, a.type);
             }
         }
 
         if (details->accesses[i].isWrite) {
             a.type = AccessType::Write;
 
-            manager->writer.insertAccess(a);
+            if (manager->aggregateAccesses)
+                a.id = aggregateAccess(tsc, details, a);
+            else
+                manager->writer.insertAccess(a);
 
             if (refid != manager->redZone.ref.id) // Ignore red zone
             {
-                if (data == NULL || manager->ignoreConflict[data->stackFctAlloc].find(data->stackDelta) == manager->ignoreConflict[data->stackFctAlloc].end()) // Ignore specifc variables
+                if (data == NULL || manager->ignoreConflict[data->ref.function].find(data->ref.stackDelta) == manager->ignoreConflict[data->ref.function].end()) // Ignore specifc variables
                 {
-                    for (auto& it: currentTagInstances) {
-                        recordTagAccess(it, a.address, a.reference, a.id, a.type);
+                    for (auto it = currentTasks.rbegin(); it != currentTasks.rend(); it++) {
+                        recordTagAccess(*it, a.address, a.size, a.reference, a.id, a.type);
                     }
+
+                    if (!loopStack.empty())
+                        recordLoopAccess(a.address, a.reference, a.type);
                 }
             }
         }
     }
 }
 
-std::list<TagInstance>::iterator ThreadManager::findCurrentTagInstance(int tagId)
+int ThreadManager::aggregateAccess(UINT64 tsc, AccessInstructionDetails* details, const Access& access)
+{
+    int segment = callStack.back().segment;
+    SegmentAccesses& accesses = accessSummaries[segment];
+
+    AccessKey key = {details, access.reference};
+
+    auto it = accesses.find(key);
+
+    if (it == accesses.end())
+    {
+        if (accessSummaryCount >= maxAccessSummaries)
+        {
+            flushAccesses();
+            return aggregateAccess(tsc, details, access);
+        }
+
+        AccessSummary summary;
+        summary.genId();
+
+        summary.instruction = getInstruction(InstructionType::Access, details->location);
+        summary.reference = access.reference;
+        summary.reads = 0;
+        summary.writes = 0;
+        summary.readBytes = 0;
+        summary.writeBytes = 0;
+        summary.firstTSC = tsc;
+
+        it = accesses.insert(std::make_pair(key, summary)).first;
+        accessSummaryCount++;
+    }
+
+    AccessSummary& summary = it->second;
+
+    if (access.type == AccessType::Read)
+    {
+        summary.reads++;
+        summary.readBytes += access.size;
+    }
+    else
+    {
+        summary.writes++;
+        summary.writeBytes += access.size;
+    }
+
+    summary.lastTSC = tsc;
+
+    return summary.id;
+}
+
+void ThreadManager::flushSegmentAccesses(int segment)
+{
+    auto it = accessSummaries.find(segment);
+
+    if (it == accessSummaries.end())
+        return;
+
+    for (auto& summary : it->second)
+    {
+        manager->writer.insertAccessSummary(summary.second);
+    }
+
+    accessSummaryCount -= it->second.size();
+    accessSummaries.erase(it);
+}
+
+void ThreadManager::flushAccesses()
+{
+    for (auto& segment : accessSummaries)
+    {
+        for (auto& summary : segment.second)
+        {
+            manager->writer.insertAccessSummary(summary.second);
+        }
+    }
+
+    accessSummaries.clear();
+    accessSummaryCount = 0;
+}
+
+void ThreadManager::handleBlockAccesses(UINT64 tsc, BlockAccessDetails* block, ADDRINT* registers, UINT64 rsp)
+{
+    ADDRINT addresses[maxMemRefAddresses];
+
+    for (auto& instruction : block->instructions)
+    {
+        if (!sampleAccess())
+            continue;
+
+        for (std::size_t i = 0; i < instruction.operands.size(); i++)
+        {
+            const BlockOperand& operand = instruction.operands[i];
+
+            addresses[i] = operand.displacement;
+
+            if (operand.base >= 0)
+                addresses[i] += registers[operand.base];
+
+            if (operand.index >= 0)
+                addresses[i] += registers[operand.index] * operand.scale;
+        }
+
+        handleMemRef(tsc, instruction.details, addresses, rsp);
+    }
+}
+
+bool ThreadManager::sampleAccess()
+{
+    if (manager->slowdownBudget == 0)
+        return true;
+
+    bool sampled = --accessSamplingCountdown == 0;
+
+    if (sampled)
+    {
+        // Random gaps averaging the period, a fixed stride could keep hitting the same instructions of a loop
+        samplingRandom ^= samplingRandom << 13;
+        samplingRandom ^= samplingRandom >> 7;
+        samplingRandom ^= samplingRandom << 17;
+
+        accessSamplingCountdown = 1 + samplingRandom % (2 * accessSamplingPeriod - 1);
+    }
+
+    if (callStack.empty())
+        return sampled;
+
+    int segment = callStack.back().segment;
+
+    if (segment != samplingSegment)
+    {
+        currentSampling = &segmentSampling[segment];
+        currentSampling->segment = segment;
+        samplingSegment = segment;
+    }
+
+    currentSampling->accesses++;
+
+    if (sampled)
+        currentSampling->sampled++;
+
+    return sampled;
+}
+
+/* Doubles the sampling period while the last buffer made the thread slower than the budget. It is only halved
+ * below half the budget, halving at most doubles the time spent on accesses so the budget holds afterwards. */
+void ThreadManager::controlOverhead(UINT64 application, UINT64 analysis)
+{
+    UINT64 budget = manager->slowdownBudget;
+
+    // The application time includes the inline instrumentation filling the buffer
+    application = std::max(application, (UINT64)1);
+
+    if (application + analysis > budget * application)
+    {
+        if (accessSamplingPeriod < maxAccessSamplingPeriod)
+            accessSamplingPeriod *= 2;
+    }
+    else if (accessSamplingPeriod > 1 && 2 * (application + analysis) < budget * application)
+    {
+        accessSamplingPeriod /= 2;
+        accessSamplingCountdown = std::min(accessSamplingCountdown, accessSamplingPeriod);
+    }
+}
+
+void ThreadManager::flushSegmentSampling(int segment)
+{
+    if (segmentSampling.empty())
+        return;
+
+    auto it = segmentSampling.find(segment);
+
+    if (it == segmentSampling.end())
+        return;
+
+    // Segments whose accesses were all processed need no scaling
+    if (it->second.sampled < it->second.accesses)
+        manager->writer.insertSegmentSampling(it->second);
+
+    if (segment == samplingSegment)
+    {
+        samplingSegment = -1;
+        currentSampling = NULL;
+    }
+
+    segmentSampling.erase(it);
+}
+
+void ThreadManager::flushSampling()
+{
+    for (auto& it : segmentSampling)
+    {
+        if (it.second.sampled < it.second.accesses)
+            manager->writer.insertSegmentSampling(it.second);
+    }
+
+    segmentSampling.clear();
+    samplingSegment = -1;
+    currentSampling = NULL;
+}
+
+int ThreadManager::getInstruction(InstructionType type, int location)
 {
-    for(auto tagInstance = currentTagInstances.begin(); tagInstance != currentTagInstances.end(); tagInstance++)
+    int segment = callStack.back().segment;
+    SegmentInstructions& instructions = instructionCache[segment];
+
+    InstructionKey key = {location, type};
+
+    auto it = instructions.find(key);
+
+    if (it != instructions.end())
+        return it->second;
+
+    Instruction instr;
+
+    instr.type = type;
+    instr.segment = segment;
+    instr.line = manager->locationDetails[location].line;
+    instr.column = manager->locationDetails[location].column;
+
+    manager->writer.insertInstruction(instr);
+    insertCurrentTagInstances(instr.id);
+
+    instructions.insert(std::make_pair(key, instr.id));
+
+    return instr.id;
+}
+
+void ThreadManager::releaseInstructions(int segment)
+{
+    instructionCache.erase(segment);
+}
+
+TagInstance* ThreadManager::findCurrentTagInstance(int tagId)
+{
+    if (tagId < 0 || (std::size_t)tagId >= currentTagInstanceIndex.size() || currentTagInstanceIndex[tagId] < 0)
+        return NULL;
+
+    return &currentTagInstances[currentTagInstanceIndex[tagId]];
+}
+
+void ThreadManager::startTagInstance(const TagInstance& instance)
+{
+    if ((std::size_t)instance.tag >= currentTagInstanceIndex.size())
+        currentTagInstanceIndex.resize(instance.tag + 1, -1);
+
+    currentTagInstanceIndex[instance.tag] = currentTagInstances.size();
+    currentTagInstances.push_back(instance);
+}
+
+void ThreadManager::stopTagInstance(int tagId)
+{
+    int index = currentTagInstanceIndex[tagId];
+
+    // Fill the gap with the last instance, the order of running instances does not matter
+    if ((std::size_t)index != currentTagInstances.size() - 1)
     {
-        if(tagInstance->tag == tagId)
-            return tagInstance;
+        currentTagInstances[index] = currentTagInstances.back();
+        currentTagInstanceIndex[currentTagInstances[index].tag] = index;
     }
 
-    return currentTagInstances.end();
+    currentTagInstances.pop_back();
+    currentTagInstanceIndex[tagId] = -1;
 }
 
 void ThreadManager::insertCurrentTagInstances(int instruction)
@@ -622,13 +1410,13 @@ void ThreadManager::insertCurrentTagInstances(int instruction)
     }
 }
 
-void ThreadManager::handleSimpleTag(UINT64 tsc, const Tag &tag, const TagInstruction &tagInstruction, std::list<TagInstance>::iterator& tagInstance)
+void ThreadManager::handleSimpleTag(UINT64 tsc, const Tag &tag, const TagInstruction &tagInstruction, TagInstance* tagInstance)
 {
     switch (tagInstruction.type)
     {
     case TagInstructionType::Start:
     {
-        if (tagInstance != currentTagInstances.end())
+        if (tagInstance != NULL)
         {
             CorruptedBufferException("Starting an already started tag");
         }
@@ -640,14 +1428,14 @@ void ThreadManager::handleSimpleTag(UINT64 tsc, const Tag &tag, const TagInstruc
         ti.tag = tag.id;
         ti.thread = self.id;
 
-        currentTagInstances.push_front(ti);
+        startTagInstance(ti);
 
         break;
     }
 
     case TagInstructionType::Stop:
     {
-        if (tagInstance == currentTagInstances.end())
+        if (tagInstance == NULL)
         {
             CorruptedBufferException("Stopping an unstarted tag");
         }
@@ -656,7 +1444,7 @@ void ThreadManager::handleSimpleTag(UINT64 tsc, const Tag &tag, const TagInstruc
 
         manager->writer.insertTagInstance(*tagInstance);
 
-        currentTagInstances.erase(tagInstance);
+        stopTagInstance(tagInstance->tag);
     }
 
     break;
@@ -665,13 +1453,13 @@ void ThreadManager::handleSimpleTag(UINT64 tsc, const Tag &tag, const TagInstruc
     }
 }
 
-void ThreadManager::handleSectionTag(UINT64 tsc, const Tag &tag, const TagInstruction &tagInstruction, std::list<TagInstance>::iterator &tagInstance)
+void ThreadManager::handleSectionTag(UINT64 tsc, const Tag &tag, const TagInstruction &tagInstruction, TagInstance* tagInstance)
 {
     switch (tagInstruction.type)
     {
     case TagInstructionType::Start:
     {
-        if (tagInstance != currentTagInstances.end())
+        if (tagInstance != NULL)
         {
             return; // Section tag can be set on loop header
         }
@@ -683,7 +1471,7 @@ void ThreadManager::handleSectionTag(UINT64 tsc, const Tag &tag, const TagInstru
         ti.tag = tag.id;
         ti.thread = self.id;
 
-        currentTagInstances.push_front(ti);
+        startTagInstance(ti);
 
         interestingProgramPart = true;
 
@@ -692,22 +1480,24 @@ void ThreadManager::handleSectionTag(UINT64 tsc, const Tag &tag, const TagInstru
 
     case TagInstructionType::Stop:
     {
-        if (tagInstance == currentTagInstances.end())
+        if (tagInstance == NULL)
         {
             CorruptedBufferException("Stopping an unstarted tag");
         }
 
+        // Ending the task may move the section
         endCurrentSectionTaskTag(tsc);
+        tagInstance = findCurrentTagInstance(tag.id);
 
         tagInstance->end = tsc;
 
         manager->writer.insertTagInstance(*tagInstance);
 
-        currentTagInstances.erase(tagInstance);
-
         closeTagInstanceAccesses(containerTagInstanceChildren[tagInstance->id]);
         containerTagInstanceChildren.erase(tagInstance->id);
 
+        stopTagInstance(tagInstance->tag);
+
         interestingProgramPart = false;
     }
 
@@ -717,13 +1507,13 @@ void ThreadManager::handleSectionTag(UINT64 tsc, const Tag &tag, const TagInstru
     }
 }
 
-void ThreadManager::handlePipelineTag(UINT64 tsc, const Tag &tag, const TagInstruction &tagInstruction, std::list<TagInstance>::iterator &tagInstance)
+void ThreadManager::handlePipelineTag(UINT64 tsc, const Tag &tag, const TagInstruction &tagInstruction, TagInstance* tagInstance)
 {
     switch (tagInstruction.type)
     {
     case TagInstructionType::Start:
     {
-        if (tagInstance != currentTagInstances.end())
+        if (tagInstance != NULL)
         {
             CorruptedBufferException("Starting an already started tag");
         }
@@ -735,7 +1525,7 @@ void ThreadManager::handlePipelineTag(UINT64 tsc, const Tag &tag, const TagInstr
         ti.tag = tag.id;
         ti.thread = self.id;
 
-        currentTagInstances.push_front(ti);
+        startTagInstance(ti);
 
         interestingProgramPart = true;
 
@@ -744,18 +1534,19 @@ void ThreadManager::handlePipelineTag(UINT64 tsc, const Tag &tag, const TagInstr
 
     case TagInstructionType::Stop:
     {
-        if (tagInstance == currentTagInstances.end())
+        if (tagInstance == NULL)
         {
             CorruptedBufferException("Stopping an unstarted tag");
         }
 
         endCurrentPipelineTaskTag(tsc);
+        tagInstance = findCurrentTagInstance(tag.id);
 
         tagInstance->end = tsc;
 
         manager->writer.insertTagInstance(*tagInstance);
 
-        currentTagInstances.erase(tagInstance);
+        stopTagInstance(tagInstance->tag);
 
         interestingProgramPart = false;
     }
@@ -766,20 +1557,20 @@ void ThreadManager::handlePipelineTag(UINT64 tsc, const Tag &tag, const TagInstr
     }
 }
 
-void ThreadManager::handleSectionTaskTag(UINT64 tsc, const Tag &tag, const TagInstruction &tagInstruction, std::list<TagInstance>::iterator &tagInstance)
+void ThreadManager::handleSectionTaskTag(UINT64 tsc, const Tag &tag, const TagInstruction &tagInstruction, TagInstance* tagInstance)
 {
     switch (tagInstruction.type)
     {
     case TagInstructionType::Start:
     {
-        if (tagInstance != currentTagInstances.end())
+        if (tagInstance != NULL)
         {
             tagInstance->end = tsc;
 
             manager->writer.insertTagInstance(*tagInstance);
-            childInstanceParent.erase(tagInstance->id);
+            endTask(tagInstance->id);
 
-            currentTagInstances.erase(tagInstance);
+            stopTagInstance(tagInstance->tag);
         }
 
         auto container = std::find_if(currentTagInstances.begin(), currentTagInstances.end(), [&] (const TagInstance& instance)
@@ -792,6 +1583,9 @@ void ThreadManager::handleSectionTaskTag(UINT64 tsc, const Tag &tag, const TagIn
         if (container == currentTagInstances.end())
             CorruptedBufferException("Found Task outside Section");
 
+        // Starting the task may move the section
+        int containerId = container->id;
+
         TagInstance ti;
         ti.genId();
 
@@ -799,11 +1593,10 @@ void ThreadManager::handleSectionTaskTag(UINT64 tsc, const Tag &tag, const TagIn
         ti.tag = tag.id;
         ti.thread = self.id;
 
-        currentTagInstances.push_front(ti);
-        tagInstanceType[ti.id] = tag.type;
+        startTagInstance(ti);
 
-        containerTagInstanceChildren[container->id].insert(ti.id);
-        childInstanceParent.insert(std::make_pair(ti.id, container->id));
+        containerTagInstanceChildren[containerId].insert(ti.id);
+        currentTasks.push_back({ti.id, containerId});
 
         interestingProgramPart = true;
 
@@ -817,7 +1610,7 @@ void ThreadManager::handleSectionTaskTag(UINT64 tsc, const Tag &tag, const TagIn
     }
 }
 
-void ThreadManager::handlePipelineTaskTag(UINT64 tsc, const Tag &tag, const TagInstruction &tagInstruction, std::list<TagInstance>::iterator &tagInstance)
+void ThreadManager::handlePipelineTaskTag(UINT64 tsc, const Tag &tag, const TagInstruction &tagInstruction, TagInstance* tagInstance)
 {
 }
 
@@ -834,12 +1627,22 @@ void ThreadManager::endCurrentSectionTaskTag(UINT64 tsc)
 
         manager->writer.insertTagInstance(*tagInstance);
 
-        currentTagInstances.erase(tagInstance);
-        tagInstanceType.erase(tagInstance->id);
-        childInstanceParent.erase(tagInstance->id);
+        endTask(tagInstance->id);
+        stopTagInstance(tagInstance->tag);
     }
 }
 
+void ThreadManager::endTask(int instance)
+{
+    auto it = std::find_if(currentTasks.begin(), currentTasks.end(), [&] (const TaskData& task)
+    {
+        return task.instance == instance;
+    });
+
+    if (it != currentTasks.end())
+        currentTasks.erase(it);
+}
+
 void ThreadManager::endCurrentPipelineTaskTag(UINT64 tsc)
 {
 }
@@ -986,59 +1789,86 @@ void ThreadManager::handleIgnoreAccessesTag(const TagInstruction &tagInstruction
     updateChecks();
 }
 
-void ThreadManager::recordTagAccess(TagInstance &instance, ADDRINT address, int reference, int access, AccessType accessType)
+void ThreadManager::recordTagAccess(const TaskData& task, ADDRINT address, int size, int reference, int access, AccessType accessType)
 {
-    TagType type = tagInstanceType[instance.id];
-
-    if(type != TagType::PipelineTask && type != TagType::SectionTask)
-        return;
+    TOOL_STAT_TIMER(stats, RecordTagAccess);
 
-    auto it = tagAccessingReference.find(reference);
+    conflictDetector.record(task.instance, task.parent, address, reference, access, accessType, conflicts);
 
-    if (accessType == AccessType::Write || tagAccessingReference[reference][address].find(instance.id) == tagAccessingReference[reference][address].end())
-        tagAccessingReference[reference][address].insert(std::make_pair(instance.id, std::make_pair(access, accessType)));
+    for (auto& c : conflicts) {
+        if (manager->summarizeConflicts)
+            summarizeConflict(c, address, size, reference);
+        else
+            manager->writer.insertConflict(c);
+    }
 
-    if (it == tagAccessingReference.end())
-        // First access of reference
-        return;
+    conflicts.clear();
+}
 
-    auto it2 = it->second.find(address);
+void ThreadManager::summarizeConflict(const Conflict& conflict, ADDRINT address, int size, int reference)
+{
+    ConflictKey key = {conflict.tagInstance1, conflict.tagInstance2, reference, conflict.type1, conflict.type2};
 
-    if (it2->second.size() == 1)
-        // Only this tags accesses at address
-        return;
+    auto it = conflictSummaries.find(key);
 
-    int parent = childInstanceParent[instance.id];
+    if (it == conflictSummaries.end())
+    {
+        ConflictSummary summary;
+
+        summary.tagInstance1 = conflict.tagInstance1;
+        summary.tagInstance2 = conflict.tagInstance2;
+        summary.reference = reference;
+        summary.type1 = conflict.type1;
+        summary.type2 = conflict.type2;
+        summary.count = 0;
+        summary.firstAccess1 = conflict.access1;
+        summary.firstAccess2 = conflict.access2;
+        summary.lowAddress = address;
+        summary.highAddress = address + size;
+
+        it = conflictSummaries.insert(std::make_pair(key, summary)).first;
+    }
 
-    for(auto it3 : it2->second) {
-        if (it3.first != instance.id && (accessType == AccessType::Write || it3.second.second == AccessType::Write) && it3.first != parent) {
-             Conflict c;
+    ConflictSummary& summary = it->second;
 
-             c.tagInstance1 = instance.id;
-             c.tagInstance2 = it3.first;
-             c.access2 = it3.second.first;
-             c.access1 = access;
+    summary.count++;
+    summary.lastAccess1 = conflict.access1;
+    summary.lastAccess2 = conflict.access2;
+    summary.lowAddress = std::min(summary.lowAddress, (UINT64)address);
+    summary.highAddress = std::max(summary.highAddress, (UINT64)address + size);
+}
 
-             manager->writer.insertConflict(c);
+void ThreadManager::flushConflictSummaries(const std::set<int>& tagInstances)
+{
+    for (auto it = conflictSummaries.begin(); it != conflictSummaries.end();)
+    {
+        if (tagInstances.find(it->first.tagInstance1) != tagInstances.end() || tagInstances.find(it->first.tagInstance2) != tagInstances.end())
+        {
+            manager->writer.insertConflictSummary(it->second);
+            it = conflictSummaries.erase(it);
+        }
+        else
+        {
+            it++;
         }
     }
 }
 
 void ThreadManager::closeTagInstanceAccesses(const std::set<int> &tagInstances)
 {
-    for(auto& it1: tagAccessingReference) {
-        for(auto& it2: it1.second) {
-            for(auto& it3: tagInstances) {
-                it2.second.erase(it3);
-            }
-        }
-    }
+    conflictDetector.close(tagInstances);
+
+    if (manager->summarizeConflicts)
+        flushConflictSummaries(tagInstances);
 }
 
 void ThreadManager::insertCallTagInstance(const ThreadManager::CallData &data)
 {
+    if (manager->aggregateCalls)
+        return;
+
     for (auto& instance : currentTagInstances) {
-        if (data.tagInstances.find(instance.id) != data.tagInstances.end()) {
+        if (data.tagInstances.contains(instance.id)) {
             CallTagInstance callTagInstance;
 
             callTagInstance.call = data.call.id;
@@ -1,8 +1,9 @@
 #ifndef THREADMANAGER_H
 #define THREADMANAGER_H
 
-#include <list>
 #include <deque>
+#include <vector>
+#include <unordered_map>
 
 #include <pin.H>
 
@@ -10,6 +11,10 @@ class ThreadManager;
 
 #include "manager.h"
 #include "buffer.h"
+#include "conflicts.h"
+#include "smallset.h"
+#include "stats.h"
+#include "telemetry.h"
 
 class ThreadManager
 {
@@ -25,6 +30,12 @@ private:
     Manager* manager;
     THREADID tid;
 
+    ToolStats stats;
+
+    /* Slot of the thread in the telemetry page, NULL if not published */
+    TelemetryThread* telemetry;
+    void publishTelemetry(UINT64 events);
+
     void handleEntry(struct BufferEntry*);
 
     void handleTag(UINT64 tsc, int tagInstructionId, ADDRINT address);
@@ -48,32 +59,200 @@ private:
           int segment;
           UINT64 rbp;
           UINT64 rsp;
-          std::set<int> tagInstances;
+          SmallSet<int, 4> tagInstances;
+
+          /* Calling context tree aggregation */
+          int cctNode;
+          UINT64 childTime;
     };
 
-    std::list<CallData> callStack;
+    std::vector<CallData> callStack;
     UINT64 lastCallTSC;
     int lastCallLocation;
 
+    /* Calling context tree, nodes are keyed by parent node, call site and function */
+    struct CCTKey {
+        int parent;
+        int callSite;
+        int function;
+
+        bool operator==(const CCTKey& other) const
+        {
+            return parent == other.parent && callSite == other.callSite && function == other.function;
+        }
+    };
+
+    struct CCTKeyHash {
+        std::size_t operator()(const CCTKey& key) const
+        {
+            return (((std::size_t)key.parent * 31 + key.callSite) * 31) ^ key.function;
+        }
+    };
+
+    std::vector<CCTNode> cct;
+    std::unordered_map<CCTKey, int, CCTKeyHash> cctIndex;
+
+    int getCCTNode(int parent, int callSite, int function);
+    void accountCCTCall(UINT64 end);
+    void flushCCT();
+
+    /* Loop executions of the thread, innermost last */
+    struct LoopShadow {
+        int reference;
+
+        /* Iterations of the last accesses, previousRead is the last read of an older iteration than lastRead */
+        int lastWrite;
+        int lastRead;
+        int previousRead;
+    };
+
+    struct LoopData {
+        LoopExecutionSummary execution;
+
+        /* Size of the call stack when the loop started, the loop belongs to the call on top of it */
+        std::size_t depth;
+        int parentSegment;
+        int segment;
+
+        int iteration;
+        UINT64 iterationStart;
+
+        /* Last accesses per address, at most maxLoopShadow of them */
+        std::unordered_map<ADDRINT, LoopShadow> shadow;
+    };
+
+    std::vector<LoopData> loopStack;
+
+    void handleLoop(UINT64 tsc, int loopId, LoopEventType type);
+    void startLoopIteration(LoopData& loop, UINT64 tsc);
+    void endLoopIteration(LoopData& loop, UINT64 tsc);
+    void endLoops(std::size_t count, UINT64 tsc);
+    void endCallLoops(UINT64 tsc);
+    void pruneLoopShadow(LoopData& loop);
+    void recordLoopAccess(ADDRINT address, int reference, AccessType type);
+
+    /* Instruction rows of a segment, executions of the same location and type share one row */
+    struct InstructionKey {
+        int location;
+        InstructionType type;
+
+        bool operator==(const InstructionKey& other) const
+        {
+            return location == other.location && type == other.type;
+        }
+    };
+
+    struct InstructionKeyHash {
+        std::size_t operator()(const InstructionKey& key) const
+        {
+            return ((std::size_t)key.location << 2) ^ (std::size_t)key.type;
+        }
+    };
+
+    typedef std::unordered_map<InstructionKey, int, InstructionKeyHash> SegmentInstructions;
+
+    std::unordered_map<int, SegmentInstructions> instructionCache;
+
+    int getInstruction(InstructionType type, int location);
+    void releaseInstructions(int segment);
+
     std::deque<AllocData> allocations; // allocated by malloc and friends tsc -> AllocationData
 
+    /* References of stack operands in the frame on top, found by address without the references lock. Slots are
+     * valid while their generation is frameGeneration, which changes whenever the top frame does. */
+    struct FrameReference {
+        ADDRINT address;
+        UINT64 generation;
+        ReferenceData* data;
+    };
+
+    static const int frameReferenceSlots = 64;
+
+    FrameReference frameReferences[frameReferenceSlots];
+    UINT64 frameGeneration;
+
+    ReferenceData* getStackOperandReference(const MemoryOperationDetails& operand, ADDRINT address, UINT64 rsp);
+
     ReferenceData& getReference(ADDRINT address, int size, UINT64 rsp);
-    void handleMemRef(AccessInstructionDetails* details, ADDRINT addresses[7], UINT64 rsp);
+    ReferenceData& createReference(ADDRINT address, int size, ReferenceType type, const CallData* frame);
+    void handleMemRef(UINT64 tsc, AccessInstructionDetails* details, ADDRINT* addresses, UINT64 rsp);
+
+    /* MemRef or BlockAccesses entry waiting for the MemRefAddresses entry with the rest of its addresses or registers */
+    BuferEntryType pendingType;
+    AccessInstructionBufferEntry pendingMemRef;
+    BlockAccessesBufferEntry pendingBlock;
+
+    /* Computes the addresses of every instruction of the block and handles them as separate MemRef entries */
+    void handleBlockAccesses(UINT64 tsc, BlockAccessDetails* block, ADDRINT* registers, UINT64 rsp);
+
+    /* Access aggregation, summaries are grouped by segment */
+    struct AccessKey {
+        AccessInstructionDetails* details;
+        int reference;
+
+        bool operator==(const AccessKey& other) const
+        {
+            return details == other.details && reference == other.reference;
+        }
+    };
+
+    struct AccessKeyHash {
+        std::size_t operator()(const AccessKey& key) const
+        {
+            return std::hash<AccessInstructionDetails*>()(key.details) ^ ((std::size_t)key.reference << 1);
+        }
+    };
 
-    std::list<TagInstance> currentTagInstances;
-    std::map<int, TagType> tagInstanceType;
-    std::list<TagInstance>::iterator findCurrentTagInstance(int tagId);
+    typedef std::unordered_map<AccessKey, AccessSummary, AccessKeyHash> SegmentAccesses;
+
+    std::unordered_map<int, SegmentAccesses> accessSummaries;
+    std::size_t accessSummaryCount;
+
+    int aggregateAccess(UINT64 tsc, AccessInstructionDetails* details, const Access& access);
+    void flushSegmentAccesses(int segment);
+    void flushAccesses();
+
+    /* Overhead control, once analysis time exceeds the slowdown budget only one in about accessSamplingPeriod
+     * memory instructions is processed, calls, returns and tags stay exact */
+    UINT64 applicationStartTSC;
+    UINT64 accessSamplingPeriod;
+    UINT64 accessSamplingCountdown;
+    UINT64 samplingRandom;
+
+    std::unordered_map<int, SegmentSampling> segmentSampling;
+    int samplingSegment;
+    SegmentSampling* currentSampling;
+
+    bool sampleAccess();
+    void controlOverhead(UINT64 application, UINT64 analysis);
+    void flushSegmentSampling(int segment);
+    void flushSampling();
+
+    /* Running tag instances, at most one per tag, indexed by Tag::id through currentTagInstanceIndex */
+    std::vector<TagInstance> currentTagInstances;
+    std::vector<int> currentTagInstanceIndex;
+    TagInstance* findCurrentTagInstance(int tagId);
+    void startTagInstance(const TagInstance& instance);
+    void stopTagInstance(int tagId);
     std::map<int, std::set<int> > containerTagInstanceChildren;
-    std::map<int, int> childInstanceParent;
+
+    /* Running task instances, the only ones whose accesses are checked for conflicts */
+    struct TaskData {
+        int instance;
+        int parent;
+    };
+
+    std::vector<TaskData> currentTasks;
+    void endTask(int instance);
 
     void insertCurrentTagInstances(int instruction);
 
     /* tag handlers */
-    void handleSimpleTag(UINT64 tsc, const Tag& tag, const TagInstruction& tagInstruction, std::list<TagInstance>::iterator& instance);
-    void handleSectionTag(UINT64 tsc, const Tag& tag, const TagInstruction& tagInstruction, std::list<TagInstance>::iterator& instance);
-    void handlePipelineTag(UINT64 tsc, const Tag& tag, const TagInstruction& tagInstruction, std::list<TagInstance>::iterator& instance);
-    void handleSectionTaskTag(UINT64 tsc, const Tag& tag, const TagInstruction& tagInstruction, std::list<TagInstance>::iterator& instance);
-    void handlePipelineTaskTag(UINT64 tsc, const Tag& tag, const TagInstruction& tagInstruction, std::list<TagInstance>::iterator& instance);
+    void handleSimpleTag(UINT64 tsc, const Tag& tag, const TagInstruction& tagInstruction, TagInstance* instance);
+    void handleSectionTag(UINT64 tsc, const Tag& tag, const TagInstruction& tagInstruction, TagInstance* instance);
+    void handlePipelineTag(UINT64 tsc, const Tag& tag, const TagInstruction& tagInstruction, TagInstance* instance);
+    void handleSectionTaskTag(UINT64 tsc, const Tag& tag, const TagInstruction& tagInstruction, TagInstance* instance);
+    void handlePipelineTaskTag(UINT64 tsc, const Tag& tag, const TagInstruction& tagInstruction, TagInstance* instance);
     void endCurrentSectionTaskTag(UINT64 tsc);
     void endCurrentPipelineTaskTag(UINT64 tsc);
 
@@ -87,8 +266,33 @@ private:
 
     /* Dependency analysis */
 
-    std::map<int, std::map<ADDRINT, std::map<int, std::pair<int, AccessType> >>> tagAccessingReference;
-    void recordTagAccess(TagInstance& instance, ADDRINT address, int reference, int access, AccessType accessType);
+    ConflictDetector conflictDetector;
+    std::vector<Conflict> conflicts;
+    void recordTagAccess(const TaskData& task, ADDRINT address, int size, int reference, int access, AccessType accessType);
+
+    struct ConflictKey {
+        int tagInstance1;
+        int tagInstance2;
+        int reference;
+        AccessType type1;
+        AccessType type2;
+
+        bool operator==(const ConflictKey& other) const
+        {
+            return tagInstance1 == other.tagInstance1 && tagInstance2 == other.tagInstance2 && reference == other.reference && type1 == other.type1 && type2 == other.type2;
+        }
+    };
+
+    struct ConflictKeyHash {
+        std::size_t operator()(const ConflictKey& key) const
+        {
+            return ((((std::size_t)key.tagInstance1 * 31 + key.tagInstance2) * 31 + key.reference) << 4) ^ ((int)key.type1 << 2) ^ (int)key.type2;
+        }
+    };
+
+    std::unordered_map<ConflictKey, ConflictSummary, ConflictKeyHash> conflictSummaries;
+    void summarizeConflict(const Conflict& conflict, ADDRINT address, int size, int reference);
+    void flushConflictSummaries(const std::set<int>& tagInstances);
     void closeTagInstanceAccesses(const std::set<int>& tagInstances);
     void insertCallTagInstance(const CallData& data);
 